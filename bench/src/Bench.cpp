@@ -0,0 +1,694 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <thread>
+#include <bit>
+#include <set>
+#include <CL/opencl.h>
+
+constexpr size_t MinTransferSize = 64;
+constexpr size_t MaxTransferSize = 64 * 1024 * 1024;
+constexpr size_t BatchBytes = 256 * 1024 * 1024;
+constexpr int MaxBatchCount = 256;
+constexpr size_t MinRowSize = 64;
+constexpr size_t MaxRowSize = 16 * 1024;
+constexpr size_t RectRowCount = 256;
+constexpr int LibraryKernelCount = 32;
+constexpr int ProgramKernelCount = 50;
+constexpr size_t DispatchSize = 1024;
+constexpr int ProducerEnqueueCount = 4096;
+constexpr int WaitDispatchCount = 100;
+constexpr int WakeCount = 64;
+constexpr int EventCount = 1024;
+constexpr size_t LocalWorkSize = 64;
+constexpr size_t MaxLocalSize = 16 * 1024;
+
+struct Environment {
+    cl_device_id Device;
+    cl_context Context;
+    cl_command_queue CommandQueue;
+};
+
+struct Suite {
+    const char *Name;
+    std::function<void(const Environment &)> Run;
+};
+
+void Check(cl_int error, const char *what) {
+    if (error != CL_SUCCESS) {
+        std::fprintf(stderr, "bench: %s failed with %d\n", what, error);
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+cl_mem CreateBuffer(const Environment &environment, cl_mem_flags flags, size_t size) {
+    cl_int error;
+    auto buffer = clCreateBuffer(environment.Context, flags, size, nullptr, &error);
+
+    Check(error, "clCreateBuffer");
+
+    return buffer;
+}
+
+std::string GetScaleSource(const std::string &name, int seed) {
+    return "__kernel void " + name + "(__global float *data) {\n"
+           "    data[get_global_id(0)] *= " + std::to_string(seed) + ".0f;\n"
+           "}\n";
+}
+
+cl_program BuildProgram(const Environment &environment, const std::string &source) {
+    auto sources = source.c_str();
+    cl_int error;
+    auto program = clCreateProgramWithSource(environment.Context, 1, &sources, nullptr, &error);
+
+    Check(error, "clCreateProgramWithSource");
+    Check(clBuildProgram(program, 1, &environment.Device, nullptr, nullptr, nullptr), "clBuildProgram");
+
+    return program;
+}
+
+// Every seed gives a distinct source and therefore a distinct Metal library.
+cl_program BuildProgram(const Environment &environment, int seed) {
+    return BuildProgram(environment, GetScaleSource("scale", seed));
+}
+
+cl_kernel CreateKernel(cl_program program) {
+    cl_int error;
+    auto kernel = clCreateKernel(program, "scale", &error);
+
+    Check(error, "clCreateKernel");
+
+    return kernel;
+}
+
+// Returns the seconds per call, after one untimed call to warm up caches and pipelines.
+double Measure(const Environment &environment, int count, const std::function<void()> &function) {
+    function();
+    Check(clFinish(environment.CommandQueue), "clFinish");
+
+    auto begin = std::chrono::steady_clock::now();
+
+    for (auto i = 0; i != count; ++i) {
+        function();
+    }
+
+    Check(clFinish(environment.CommandQueue), "clFinish");
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() / count;
+}
+
+int GetBatchCount(size_t size) {
+    return static_cast<int>(std::clamp<size_t>(BatchBytes / size, 4, MaxBatchCount));
+}
+
+void PrintResult(const char *suite, const std::string &name, size_t size, double seconds) {
+    std::printf("%-10s %-32s %10zu bytes %12.2f us %10.2f GB/s\n", suite, name.c_str(), size, seconds * 1e6,
+                size / seconds / 1e9);
+}
+
+void PrintLatency(const char *suite, const std::string &name, double seconds) {
+    std::printf("%-10s %-32s %12.2f us\n", suite, name.c_str(), seconds * 1e6);
+}
+
+// Sweeps non-blocking transfers through a private buffer, which always goes through the staging ring or, above a
+// quarter of its capacity, a dedicated staging buffer.
+void RunTransferSuite(const Environment &environment) {
+    auto buffer = CreateBuffer(environment, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, MaxTransferSize);
+    std::vector<uint8_t> data(MaxTransferSize);
+
+    for (auto size = MinTransferSize; size <= MaxTransferSize; size *= 4) {
+        auto count = GetBatchCount(size);
+
+        PrintResult("transfer", "write", size, Measure(environment, count, [&]() {
+            Check(clEnqueueWriteBuffer(environment.CommandQueue, buffer, CL_FALSE, 0, size, data.data(), 0, nullptr,
+                                       nullptr), "clEnqueueWriteBuffer");
+        }));
+        PrintResult("transfer", "read", size, Measure(environment, count, [&]() {
+            Check(clEnqueueReadBuffer(environment.CommandQueue, buffer, CL_FALSE, 0, size, data.data(), 0, nullptr,
+                                      nullptr), "clEnqueueReadBuffer");
+        }));
+        PrintResult("transfer", "blocking read", size, Measure(environment, count, [&]() {
+            Check(clEnqueueReadBuffer(environment.CommandQueue, buffer, CL_TRUE, 0, size, data.data(), 0, nullptr,
+                                      nullptr), "clEnqueueReadBuffer");
+        }));
+    }
+
+    clReleaseMemObject(buffer);
+}
+
+// Compares blocking transfers on a host-accessible buffer, which are copied directly on unified memory, with the same
+// transfers on a private buffer, which are staged and blitted.
+void RunHostAccessSuite(const Environment &environment) {
+    auto directBuffer = CreateBuffer(environment, CL_MEM_READ_WRITE, MaxTransferSize);
+    auto stagedBuffer = CreateBuffer(environment, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, MaxTransferSize);
+    std::vector<uint8_t> data(MaxTransferSize);
+
+    for (auto size = MinTransferSize; size <= MaxTransferSize; size *= 4) {
+        auto count = GetBatchCount(size);
+
+        for (auto [name, buffer]: {std::pair{"direct", directBuffer}, std::pair{"staged", stagedBuffer}}) {
+            PrintResult("host", std::string{name} + " blocking write", size, Measure(environment, count, [&]() {
+                Check(clEnqueueWriteBuffer(environment.CommandQueue, buffer, CL_TRUE, 0, size, data.data(), 0,
+                                           nullptr, nullptr), "clEnqueueWriteBuffer");
+            }));
+            PrintResult("host", std::string{name} + " blocking read", size, Measure(environment, count, [&]() {
+                Check(clEnqueueReadBuffer(environment.CommandQueue, buffer, CL_TRUE, 0, size, data.data(), 0,
+                                          nullptr, nullptr), "clEnqueueReadBuffer");
+            }));
+        }
+    }
+
+    clReleaseMemObject(stagedBuffer);
+    clReleaseMemObject(directBuffer);
+}
+
+// Compares one rect call over rows spaced two rows apart with the same rows moved by one call each, which is what an
+// application without rect support would do. Host-accessible buffers copy rows on the host, private buffers go
+// through the blit and compute paths.
+void RunRectSuite(const Environment &environment) {
+    std::vector<uint8_t> data(MaxRowSize * RectRowCount);
+    std::pair<const char *, cl_mem_flags> flagsList[] = {{"direct", CL_MEM_READ_WRITE},
+                                                         {"private", CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS}};
+
+    for (auto [name, flags]: flagsList) {
+        auto srcBuffer = CreateBuffer(environment, flags, 2 * MaxRowSize * RectRowCount);
+        auto dstBuffer = CreateBuffer(environment, flags, 2 * MaxRowSize * RectRowCount);
+        auto prefix = std::string{name} + " ";
+
+        for (auto rowSize = MinRowSize; rowSize <= MaxRowSize; rowSize *= 4) {
+            auto size = rowSize * RectRowCount;
+            auto count = GetBatchCount(size);
+            size_t origin[3] = {0, 0, 0};
+            size_t region[3] = {rowSize, RectRowCount, 1};
+
+            PrintResult("rect", prefix + "rect write", size, Measure(environment, count, [&]() {
+                Check(clEnqueueWriteBufferRect(environment.CommandQueue, dstBuffer, CL_FALSE, origin, origin, region,
+                                               2 * rowSize, 0, rowSize, 0, data.data(), 0, nullptr, nullptr),
+                      "clEnqueueWriteBufferRect");
+            }));
+            PrintResult("rect", prefix + "per-row write", size, Measure(environment, count, [&]() {
+                for (size_t row = 0; row != RectRowCount; ++row) {
+                    Check(clEnqueueWriteBuffer(environment.CommandQueue, dstBuffer, CL_FALSE, 2 * rowSize * row,
+                                               rowSize, data.data() + rowSize * row, 0, nullptr, nullptr),
+                          "clEnqueueWriteBuffer");
+                }
+            }));
+            PrintResult("rect", prefix + "rect read", size, Measure(environment, count, [&]() {
+                Check(clEnqueueReadBufferRect(environment.CommandQueue, srcBuffer, CL_FALSE, origin, origin, region,
+                                              2 * rowSize, 0, rowSize, 0, data.data(), 0, nullptr, nullptr),
+                      "clEnqueueReadBufferRect");
+            }));
+            PrintResult("rect", prefix + "per-row read", size, Measure(environment, count, [&]() {
+                for (size_t row = 0; row != RectRowCount; ++row) {
+                    Check(clEnqueueReadBuffer(environment.CommandQueue, srcBuffer, CL_FALSE, 2 * rowSize * row,
+                                              rowSize, data.data() + rowSize * row, 0, nullptr, nullptr),
+                          "clEnqueueReadBuffer");
+                }
+            }));
+            PrintResult("rect", prefix + "rect copy", size, Measure(environment, count, [&]() {
+                Check(clEnqueueCopyBufferRect(environment.CommandQueue, srcBuffer, dstBuffer, origin, origin, region,
+                                              2 * rowSize, 0, 2 * rowSize, 0, 0, nullptr, nullptr),
+                      "clEnqueueCopyBufferRect");
+            }));
+            PrintResult("rect", prefix + "per-row copy", size, Measure(environment, count, [&]() {
+                for (size_t row = 0; row != RectRowCount; ++row) {
+                    Check(clEnqueueCopyBuffer(environment.CommandQueue, srcBuffer, dstBuffer, 2 * rowSize * row,
+                                              2 * rowSize * row, rowSize, 0, nullptr, nullptr),
+                          "clEnqueueCopyBuffer");
+                }
+            }));
+        }
+
+        clReleaseMemObject(dstBuffer);
+        clReleaseMemObject(srcBuffer);
+    }
+}
+
+// Times a full map and unmap round trip for every map flag on a host-accessible buffer, which maps its own storage,
+// and a private buffer, which maps through a staging copy. Non-blocking maps wait on their event instead.
+void RunMapSuite(const Environment &environment) {
+    auto directBuffer = CreateBuffer(environment, CL_MEM_READ_WRITE, MaxTransferSize);
+    auto stagedBuffer = CreateBuffer(environment, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, MaxTransferSize);
+    std::pair<const char *, cl_map_flags> flagsList[] = {{"read", CL_MAP_READ},
+                                                         {"write", CL_MAP_WRITE},
+                                                         {"read write", CL_MAP_READ | CL_MAP_WRITE},
+                                                         {"write invalidate", CL_MAP_WRITE_INVALIDATE_REGION}};
+
+    for (auto size = MinTransferSize; size <= MaxTransferSize; size *= 16) {
+        auto count = GetBatchCount(size);
+
+        for (auto [name, buffer]: {std::pair{"direct", directBuffer}, std::pair{"staged", stagedBuffer}}) {
+            for (auto [flagsName, flags]: flagsList) {
+                for (auto blocking: {CL_TRUE, CL_FALSE}) {
+                    auto label = std::string{name} + (blocking ? " blocking " : " ") + flagsName;
+
+                    PrintResult("map", label, size, Measure(environment, count, [&]() {
+                        cl_int error;
+                        cl_event event = nullptr;
+                        auto pointer = clEnqueueMapBuffer(environment.CommandQueue, buffer, blocking, flags, 0, size,
+                                                          0, nullptr, blocking ? nullptr : &event, &error);
+
+                        Check(error, "clEnqueueMapBuffer");
+
+                        if (event) {
+                            Check(clWaitForEvents(1, &event), "clWaitForEvents");
+                            clReleaseEvent(event);
+                        }
+
+                        Check(clEnqueueUnmapMemObject(environment.CommandQueue, buffer, pointer, 0, nullptr, nullptr),
+                              "clEnqueueUnmapMemObject");
+                        Check(clFinish(environment.CommandQueue), "clFinish");
+                    }));
+                }
+            }
+        }
+    }
+
+    clReleaseMemObject(stagedBuffer);
+    clReleaseMemObject(directBuffer);
+}
+
+// Times kernel creation, which looks up the Metal library in the library pool. A kernel of an already built program
+// hits the pool, a kernel of a fresh program misses and compiles its library. Misses are also spread over several
+// threads, which only scale if the libraries compile outside the pool lock. Programs are built before timing.
+void RunLibrarySuite(const Environment &environment) {
+    auto program = BuildProgram(environment, 0);
+
+    clReleaseKernel(CreateKernel(program));
+
+    PrintLatency("library", "hit", Measure(environment, LibraryKernelCount, [&]() {
+        clReleaseKernel(CreateKernel(program));
+    }));
+
+    clReleaseProgram(program);
+
+    for (auto threadCount: {1, 2, 4, 8}) {
+        std::vector<cl_program> programs;
+        std::vector<cl_kernel> kernels(LibraryKernelCount * threadCount);
+        std::vector<std::thread> threads;
+
+        for (auto i = 0; i != LibraryKernelCount * threadCount; ++i) {
+            programs.push_back(BuildProgram(environment, threadCount * 1000 + i + 1));
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+
+        for (auto i = 0; i != threadCount; ++i) {
+            threads.emplace_back([&, i]() {
+                for (auto j = i * LibraryKernelCount; j != (i + 1) * LibraryKernelCount; ++j) {
+                    kernels[j] = CreateKernel(programs[j]);
+                }
+            });
+        }
+
+        for (auto &thread: threads) {
+            thread.join();
+        }
+
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        PrintLatency("library", "miss on " + std::to_string(threadCount) + " threads",
+                     seconds / static_cast<double>(kernels.size()));
+
+        for (size_t i = 0; i != kernels.size(); ++i) {
+            clReleaseKernel(kernels[i]);
+            clReleaseProgram(programs[i]);
+        }
+    }
+}
+
+// Times creating every kernel of a program with many entry points, in one call and one kernel at a time. The program is
+// translated to MSL once when it is built, so either way a kernel should only cost a lookup.
+void RunKernelSuite(const Environment &environment) {
+    std::string source;
+
+    for (auto i = 0; i != ProgramKernelCount; ++i) {
+        source += GetScaleSource("scale" + std::to_string(i), i);
+    }
+
+    auto program = BuildProgram(environment, source);
+    std::vector<cl_kernel> kernels(ProgramKernelCount);
+    auto suffix = " of " + std::to_string(ProgramKernelCount) + " kernels";
+
+    PrintLatency("kernel", "all at once" + suffix, Measure(environment, 16, [&]() {
+        Check(clCreateKernelsInProgram(program, ProgramKernelCount, kernels.data(), nullptr),
+              "clCreateKernelsInProgram");
+
+        for (auto kernel: kernels) {
+            clReleaseKernel(kernel);
+        }
+    }));
+    PrintLatency("kernel", "one by one" + suffix, Measure(environment, 16, [&]() {
+        for (auto i = 0; i != ProgramKernelCount; ++i) {
+            cl_int error;
+
+            kernels[i] = clCreateKernel(program, ("scale" + std::to_string(i)).c_str(), &error);
+            Check(error, "clCreateKernel");
+        }
+
+        for (auto kernel: kernels) {
+            clReleaseKernel(kernel);
+        }
+    }));
+
+    clReleaseProgram(program);
+}
+
+// Times small dispatches enqueued to one queue from several producer threads at once. Every thread has its own kernel
+// and buffer, so only the queue is shared, and the time per enqueue drops as long as encoding scales with threads.
+void RunQueueSuite(const Environment &environment) {
+    auto program = BuildProgram(environment, 1);
+
+    for (auto threadCount: {1, 2, 4, 8}) {
+        std::vector<cl_kernel> kernels;
+        std::vector<cl_mem> buffers;
+        std::vector<std::thread> threads;
+
+        for (auto i = 0; i != threadCount; ++i) {
+            kernels.push_back(CreateKernel(program));
+            buffers.push_back(CreateBuffer(environment, CL_MEM_READ_WRITE, DispatchSize * sizeof(float)));
+            Check(clSetKernelArg(kernels[i], 0, sizeof(buffers[i]), &buffers[i]), "clSetKernelArg");
+        }
+
+        Check(clEnqueueNDRangeKernel(environment.CommandQueue, kernels[0], 1, nullptr, &DispatchSize, nullptr, 0,
+                                     nullptr, nullptr), "clEnqueueNDRangeKernel");
+        Check(clFinish(environment.CommandQueue), "clFinish");
+
+        auto begin = std::chrono::steady_clock::now();
+
+        for (auto i = 0; i != threadCount; ++i) {
+            threads.emplace_back([&, i]() {
+                for (auto j = 0; j != ProducerEnqueueCount; ++j) {
+                    Check(clEnqueueNDRangeKernel(environment.CommandQueue, kernels[i], 1, nullptr, &DispatchSize,
+                                                 nullptr, 0, nullptr, nullptr), "clEnqueueNDRangeKernel");
+                }
+            });
+        }
+
+        for (auto &thread: threads) {
+            thread.join();
+        }
+
+        Check(clFinish(environment.CommandQueue), "clFinish");
+
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        PrintLatency("queue", "enqueue on " + std::to_string(threadCount) + " threads",
+                     seconds / (ProducerEnqueueCount * threadCount));
+
+        for (auto i = 0; i != threadCount; ++i) {
+            clReleaseMemObject(buffers[i]);
+            clReleaseKernel(kernels[i]);
+        }
+    }
+
+    clReleaseProgram(program);
+}
+
+// Times waiting on the first and on the last of a queue full of dispatches, which only differ if a wait returns as soon
+// as its own command completes. Wake-up latency is the time from completing a user event to its waiter returning,
+// once while the waiter still spins and once after it went to sleep.
+void RunWaitSuite(const Environment &environment) {
+    auto program = BuildProgram(environment, 1);
+    auto kernel = CreateKernel(program);
+    auto buffer = CreateBuffer(environment, CL_MEM_READ_WRITE, DispatchSize * sizeof(float));
+
+    Check(clSetKernelArg(kernel, 0, sizeof(buffer), &buffer), "clSetKernelArg");
+
+    for (auto [name, index]: {std::pair{"first", 0}, std::pair{"last", WaitDispatchCount - 1}}) {
+        auto label = std::string{"wait on "} + name + " of " + std::to_string(WaitDispatchCount) + " dispatches";
+        double seconds = 0.0;
+
+        for (auto i = 0; i != WakeCount; ++i) {
+            cl_event event = nullptr;
+
+            for (auto j = 0; j != WaitDispatchCount; ++j) {
+                Check(clEnqueueNDRangeKernel(environment.CommandQueue, kernel, 1, nullptr, &DispatchSize, nullptr, 0,
+                                             nullptr, j == index ? &event : nullptr), "clEnqueueNDRangeKernel");
+            }
+
+            auto begin = std::chrono::steady_clock::now();
+
+            Check(clWaitForEvents(1, &event), "clWaitForEvents");
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+            clReleaseEvent(event);
+            Check(clFinish(environment.CommandQueue), "clFinish");
+        }
+
+        PrintLatency("wait", label, seconds / WakeCount);
+    }
+
+    for (auto [name, delay]: {std::pair{"spinning", std::chrono::microseconds(10)},
+                              std::pair{"sleeping", std::chrono::microseconds(1000)}}) {
+        double seconds = 0.0;
+
+        for (auto i = 0; i != WakeCount; ++i) {
+            cl_int error;
+            auto event = clCreateUserEvent(environment.Context, &error);
+            std::chrono::steady_clock::time_point end;
+
+            Check(error, "clCreateUserEvent");
+
+            std::thread waiter{[&]() {
+                Check(clWaitForEvents(1, &event), "clWaitForEvents");
+                end = std::chrono::steady_clock::now();
+            }};
+
+            std::this_thread::sleep_for(delay);
+
+            auto begin = std::chrono::steady_clock::now();
+
+            Check(clSetUserEventStatus(event, CL_COMPLETE), "clSetUserEventStatus");
+            waiter.join();
+            seconds += std::chrono::duration<double>(end - begin).count();
+
+            clReleaseEvent(event);
+        }
+
+        PrintLatency("wait", std::string{"wake-up while "} + name, seconds / WakeCount);
+    }
+
+    clReleaseMemObject(buffer);
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+}
+
+// Times the cost events add to an enqueue and to a user event, and the latency of a dependency on an event of the same
+// queue compared with one of another queue, which waits on the other queue's timeline.
+void RunEventSuite(const Environment &environment) {
+    auto program = BuildProgram(environment, 1);
+    auto kernel = CreateKernel(program);
+    auto buffer = CreateBuffer(environment, CL_MEM_READ_WRITE, DispatchSize * sizeof(float));
+    cl_int error;
+    auto otherCommandQueue = clCreateCommandQueueWithProperties(environment.Context, environment.Device, nullptr,
+                                                                &error);
+
+    Check(error, "clCreateCommandQueueWithProperties");
+    Check(clSetKernelArg(kernel, 0, sizeof(buffer), &buffer), "clSetKernelArg");
+
+    PrintLatency("event", "enqueue without event", Measure(environment, EventCount, [&]() {
+        Check(clEnqueueNDRangeKernel(environment.CommandQueue, kernel, 1, nullptr, &DispatchSize, nullptr, 0, nullptr,
+                                     nullptr), "clEnqueueNDRangeKernel");
+    }));
+    PrintLatency("event", "enqueue with event", Measure(environment, EventCount, [&]() {
+        cl_event event;
+
+        Check(clEnqueueNDRangeKernel(environment.CommandQueue, kernel, 1, nullptr, &DispatchSize, nullptr, 0, nullptr,
+                                     &event), "clEnqueueNDRangeKernel");
+        clReleaseEvent(event);
+    }));
+    PrintLatency("event", "user event", Measure(environment, EventCount, [&]() {
+        auto event = clCreateUserEvent(environment.Context, &error);
+
+        Check(error, "clCreateUserEvent");
+        clReleaseEvent(event);
+    }));
+
+    for (auto [name, commandQueue]: {std::pair{"same queue", environment.CommandQueue},
+                                     std::pair{"other queue", otherCommandQueue}}) {
+        PrintLatency("event", std::string{"dependency on "} + name, Measure(environment, WakeCount, [&]() {
+            cl_event event;
+
+            Check(clEnqueueNDRangeKernel(environment.CommandQueue, kernel, 1, nullptr, &DispatchSize, nullptr, 0,
+                                         nullptr, &event), "clEnqueueNDRangeKernel");
+            Check(clEnqueueNDRangeKernel(commandQueue, kernel, 1, nullptr, &DispatchSize, nullptr, 1, &event, nullptr),
+                  "clEnqueueNDRangeKernel");
+            Check(clFinish(commandQueue), "clFinish");
+            clReleaseEvent(event);
+        }));
+    }
+
+    clReleaseCommandQueue(otherCommandQueue);
+    clReleaseMemObject(buffer);
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+}
+
+// Times a dispatch after every change of a __local argument size. Sizes are rounded up to power-of-two buckets, and the
+// first size of every bucket still compiles a full Metal library, so the compile count is printed with the latency.
+void RunLocalSuite(const Environment &environment) {
+    auto program = BuildProgram(environment, "__kernel void reverse(__global float *data, __local float *scratch) {\n"
+                                             "    size_t i = get_local_id(0);\n"
+                                             "    scratch[i] = data[get_global_id(0)];\n"
+                                             "    barrier(CLK_LOCAL_MEM_FENCE);\n"
+                                             "    data[get_global_id(0)] = scratch[get_local_size(0) - 1 - i];\n"
+                                             "}\n");
+    cl_int error;
+    auto kernel = clCreateKernel(program, "reverse", &error);
+    auto buffer = CreateBuffer(environment, CL_MEM_READ_WRITE, DispatchSize * sizeof(float));
+    std::set<size_t> buckets;
+    double compileSeconds = 0.0;
+    double reuseSeconds = 0.0;
+    int reuseCount = 0;
+
+    Check(error, "clCreateKernel");
+    Check(clSetKernelArg(kernel, 0, sizeof(buffer), &buffer), "clSetKernelArg");
+
+    for (auto size = LocalWorkSize * sizeof(float); size <= MaxLocalSize; size += LocalWorkSize * sizeof(float)) {
+        auto compiles = buckets.insert(std::bit_ceil(size)).second;
+        auto begin = std::chrono::steady_clock::now();
+
+        Check(clSetKernelArg(kernel, 1, size, nullptr), "clSetKernelArg");
+        Check(clEnqueueNDRangeKernel(environment.CommandQueue, kernel, 1, nullptr, &DispatchSize, &LocalWorkSize, 0,
+                                     nullptr, nullptr), "clEnqueueNDRangeKernel");
+        Check(clFinish(environment.CommandQueue), "clFinish");
+
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        if (compiles) {
+            compileSeconds += seconds;
+        } else {
+            reuseSeconds += seconds;
+            reuseCount++;
+        }
+    }
+
+    PrintLatency("local", "new bucket, " + std::to_string(buckets.size()) + " library compiles",
+                 compileSeconds / static_cast<double>(buckets.size()));
+    PrintLatency("local", "known bucket, " + std::to_string(reuseCount) + " sizes", reuseSeconds / reuseCount);
+
+    clReleaseMemObject(buffer);
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+}
+
+#ifdef cl_khr_command_buffer
+
+// Compares replaying a recorded command buffer of small dispatches with enqueueing the same dispatches one by one.
+void RunReplaySuite(const Environment &environment) {
+    auto program = BuildProgram(environment, 1);
+    auto kernel = CreateKernel(program);
+    auto buffer = CreateBuffer(environment, CL_MEM_READ_WRITE, DispatchSize * sizeof(float));
+
+    Check(clSetKernelArg(kernel, 0, sizeof(buffer), &buffer), "clSetKernelArg");
+
+    for (auto dispatchCount: {1, 16, 256}) {
+        cl_int error;
+        auto commandBuffer = clCreateCommandBufferKHR(1, &environment.CommandQueue, nullptr, &error);
+
+        Check(error, "clCreateCommandBufferKHR");
+
+        for (auto i = 0; i != dispatchCount; ++i) {
+            Check(clCommandNDRangeKernelKHR(commandBuffer, nullptr, nullptr, kernel, 1, nullptr, &DispatchSize,
+                                            nullptr, 0, nullptr, nullptr, nullptr), "clCommandNDRangeKernelKHR");
+        }
+
+        Check(clFinalizeCommandBufferKHR(commandBuffer), "clFinalizeCommandBufferKHR");
+
+        auto suffix = " of " + std::to_string(dispatchCount) + " dispatches";
+
+        PrintLatency("replay", "direct" + suffix, Measure(environment, 64, [&]() {
+            for (auto i = 0; i != dispatchCount; ++i) {
+                Check(clEnqueueNDRangeKernel(environment.CommandQueue, kernel, 1, nullptr, &DispatchSize, nullptr, 0,
+                                             nullptr, nullptr), "clEnqueueNDRangeKernel");
+            }
+        }));
+        PrintLatency("replay", "replay" + suffix, Measure(environment, 64, [&]() {
+            Check(clEnqueueCommandBufferKHR(0, nullptr, commandBuffer, 0, nullptr, nullptr),
+                  "clEnqueueCommandBufferKHR");
+        }));
+
+        clReleaseCommandBufferKHR(commandBuffer);
+    }
+
+    clReleaseMemObject(buffer);
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+}
+
+#endif
+
+std::vector<Suite> GetSuites() {
+    return {{"transfer", RunTransferSuite},
+            {"host", RunHostAccessSuite},
+            {"rect", RunRectSuite},
+            {"map", RunMapSuite},
+            {"library", RunLibrarySuite},
+            {"kernel", RunKernelSuite},
+            {"queue", RunQueueSuite},
+            {"wait", RunWaitSuite},
+            {"event", RunEventSuite},
+            {"local", RunLocalSuite},
+#ifdef cl_khr_command_buffer
+            {"replay", RunReplaySuite},
+#endif
+    };
+}
+
+int main(int argc, char **argv) {
+    cl_platform_id platform;
+    cl_device_id device;
+    cl_int error;
+
+    Check(clGetPlatformIDs(1, &platform, nullptr), "clGetPlatformIDs");
+    Check(clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, nullptr), "clGetDeviceIDs");
+
+    Environment environment{};
+
+    environment.Device = device;
+    environment.Context = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &error);
+    Check(error, "clCreateContext");
+
+    environment.CommandQueue = clCreateCommandQueueWithProperties(environment.Context, device, nullptr, &error);
+    Check(error, "clCreateCommandQueueWithProperties");
+
+    // Only the suites named on the command line run, or all of them without arguments.
+    for (auto &suite: GetSuites()) {
+        auto selected = argc == 1;
+
+        for (auto i = 1; i < argc; ++i) {
+            selected |= suite.Name == std::string{argv[i]};
+        }
+
+        if (selected) {
+            suite.Run(environment);
+        }
+    }
+
+    clReleaseCommandQueue(environment.CommandQueue);
+    clReleaseContext(environment.Context);
+
+    return EXIT_SUCCESS;
+}
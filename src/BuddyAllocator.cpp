@@ -0,0 +1,118 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include "BuddyAllocator.h"
+
+#include <bit>
+#include <cassert>
+#include <algorithm>
+
+namespace cml {
+
+BuddyAllocator::BuddyAllocator(uint64_t size, uint64_t minBlockSize)
+    : mSize{size}, mMinBlockSize{minBlockSize}, mUsedSize{0}, mFreeBlocks{}, mAllocatedOrders{} {
+    assert(std::has_single_bit(mSize) && std::has_single_bit(mMinBlockSize) && mMinBlockSize <= mSize);
+
+    mFreeBlocks.resize(GetOrder(mSize) + 1);
+    mFreeBlocks.back().insert(0);
+}
+
+bool BuddyAllocator::Allocate(uint64_t size, uint64_t &offset) {
+    if (!size || size > mSize) {
+        return false;
+    }
+
+    auto order = GetOrder(size);
+    auto freeOrder = order;
+
+    while (freeOrder < mFreeBlocks.size() && mFreeBlocks[freeOrder].empty()) {
+        freeOrder++;
+    }
+
+    if (freeOrder == mFreeBlocks.size()) {
+        return false;
+    }
+
+    // Take the lowest block, so allocations pack towards the start and the end stays free for large requests.
+    offset = *mFreeBlocks[freeOrder].begin();
+    mFreeBlocks[freeOrder].erase(mFreeBlocks[freeOrder].begin());
+
+    while (freeOrder > order) {
+        freeOrder--;
+        mFreeBlocks[freeOrder].insert(offset + GetBlockSize(freeOrder));
+    }
+
+    mAllocatedOrders[offset] = order;
+    mUsedSize += GetBlockSize(order);
+
+    return true;
+}
+
+void BuddyAllocator::Free(uint64_t offset) {
+    assert(mAllocatedOrders.contains(offset));
+
+    auto order = mAllocatedOrders.at(offset);
+
+    mAllocatedOrders.erase(offset);
+    mUsedSize -= GetBlockSize(order);
+
+    while (order + 1 < mFreeBlocks.size()) {
+        auto buddy = offset ^ GetBlockSize(order);
+        auto iterator = mFreeBlocks[order].find(buddy);
+
+        if (iterator == mFreeBlocks[order].end()) {
+            break;
+        }
+
+        mFreeBlocks[order].erase(iterator);
+        offset = std::min(offset, buddy);
+        order++;
+    }
+
+    mFreeBlocks[order].insert(offset);
+}
+
+uint64_t BuddyAllocator::GetSize() const {
+    return mSize;
+}
+
+uint64_t BuddyAllocator::GetUsedSize() const {
+    return mUsedSize;
+}
+
+uint64_t BuddyAllocator::GetLargestFreeSize() const {
+    for (auto order = mFreeBlocks.size(); order; --order) {
+        if (!mFreeBlocks[order - 1].empty()) {
+            return GetBlockSize(order - 1);
+        }
+    }
+
+    return 0;
+}
+
+bool BuddyAllocator::IsEmpty() const {
+    return mAllocatedOrders.empty();
+}
+
+uint32_t BuddyAllocator::GetOrder(uint64_t size) const {
+    return std::countr_zero(std::bit_ceil(std::max(size, mMinBlockSize)) / mMinBlockSize);
+}
+
+uint64_t BuddyAllocator::GetBlockSize(uint32_t order) const {
+    return mMinBlockSize << order;
+}
+
+} //namespace cml
@@ -0,0 +1,50 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_BUDDY_ALLOCATOR_H
+#define CLMTL_BUDDY_ALLOCATOR_H
+
+#include <cstdint>
+#include <set>
+#include <vector>
+#include <unordered_map>
+
+namespace cml {
+
+class BuddyAllocator {
+public:
+    BuddyAllocator(uint64_t size, uint64_t minBlockSize);
+    bool Allocate(uint64_t size, uint64_t &offset);
+    void Free(uint64_t offset);
+    uint64_t GetSize() const;
+    uint64_t GetUsedSize() const;
+    uint64_t GetLargestFreeSize() const;
+    bool IsEmpty() const;
+
+private:
+    uint64_t mSize;
+    uint64_t mMinBlockSize;
+    uint64_t mUsedSize;
+    std::vector<std::set<uint64_t>> mFreeBlocks;
+    std::unordered_map<uint64_t, uint32_t> mAllocatedOrders;
+
+    uint32_t GetOrder(uint64_t size) const;
+    uint64_t GetBlockSize(uint32_t order) const;
+};
+
+} //namespace cml
+
+#endif //CLMTL_BUDDY_ALLOCATOR_H
@@ -16,6 +16,8 @@
 
 #include "Buffer.h"
 
+#include <unistd.h>
+
 #include "Util.h"
 #include "Context.h"
 #include "Device.h"
@@ -38,46 +40,72 @@ static MTL::ResourceOptions convertToResourceOptions(cl_mem_flags flags) {
     return options;
 }
 
+static bool isPageAligned(const void *data, size_t size) {
+    auto pageSize = static_cast<size_t>(getpagesize());
+
+    return !(reinterpret_cast<uintptr_t>(data) % pageSize) && !(size % pageSize);
+}
+
 Buffer *Buffer::DownCast(cl_mem buffer) {
     return (Buffer *) buffer;
 }
 
 Buffer::Buffer(Context *context, cl_mem_flags flags, size_t size)
-    : Memory{context, flags, CL_MEM_OBJECT_BUFFER}, mParent{nullptr}, mHeap{nullptr}, mBuffer{nullptr} {
+    : Memory{context, flags, CL_MEM_OBJECT_BUFFER}, mParent{nullptr}, mAllocation{}, mHeap{nullptr}
+    , mOffset{0}, mBuffer{nullptr} {
     InitHeap(size);
-    InitBuffer(size, 0);
+    InitBuffer(size, mAllocation.Offset);
 }
 
 Buffer::Buffer(Context *context, cl_mem_flags flags, const void *data, size_t size)
-    : Memory{context, flags, CL_MEM_OBJECT_BUFFER}, mParent{nullptr}, mHeap{nullptr}, mBuffer{nullptr} {
-    InitHeap(size);
-    InitBuffer(size, 0);
-    InitData(data, size);
+    : Memory{context, flags, CL_MEM_OBJECT_BUFFER}, mParent{nullptr}, mAllocation{}, mHeap{nullptr}
+    , mOffset{0}, mBuffer{nullptr} {
+    if (Util::TestAnyFlagSet(flags, CL_MEM_USE_HOST_PTR)) {
+        mHostPtr = const_cast<void *>(data);
+    }
+
+    // Metal can only wrap whole pages of host memory, anything else is copied and synchronized on map and unmap.
+    if (mHostPtr && !Util::TestAnyFlagSet(flags, CL_MEM_HOST_NO_ACCESS) && isPageAligned(data, size)) {
+        InitBuffer(data, size);
+    } else {
+        InitHeap(size);
+        InitBuffer(size, mAllocation.Offset);
+        InitData(data, size);
+    }
 }
 
 Buffer::Buffer(Buffer *parent, cl_mem_flags flags, const cl_buffer_region *region)
-    : Memory{parent->GetContext(), flags, CL_MEM_OBJECT_BUFFER}, mParent{parent}, mHeap{nullptr}, mBuffer{nullptr} {
-    InitHeap();
-    InitBuffer(region->size, region->origin);
+    : Memory{parent->GetContext(), flags, CL_MEM_OBJECT_BUFFER}, mParent{parent}, mAllocation{}
+    , mHeap{nullptr}, mOffset{0}, mBuffer{nullptr} {
+    if (auto hostPtr = parent->GetHostPtr()) {
+        mHostPtr = static_cast<uint8_t *>(hostPtr) + region->origin;
+    }
+
+    mParent->Retain();
+
+    if (parent->GetHeap()) {
+        InitHeap();
+        InitBuffer(region->size, parent->GetOffset() + region->origin);
+    } else {
+        InitBuffer(static_cast<uint8_t *>(parent->GetBuffer()->contents()) + region->origin, region->size);
+    }
 }
 
 Buffer::~Buffer() {
     mBuffer->release();
-    mHeap->release();
-}
 
-void *Buffer::Map() {
-    if (Util::TestAnyFlagSet(mFlags, CL_MEM_HOST_NO_ACCESS)) {
-        return nullptr;
-    } else {
-        ++mMapCount;
-        return mBuffer->contents();
+    if (mHeap) {
+        if (!mParent) {
+            mContext->GetDevice()->GetBufferAllocator()->Free(mAllocation);
+        }
+
+        mHeap->release();
     }
-}
 
-void Buffer::Unmap() {
-    if (mMapCount) {
-        --mMapCount;
+    if (mParent) {
+        if (!mParent->Release()) {
+            delete mParent;
+        }
     }
 }
 
@@ -89,25 +117,21 @@ MTL::Heap *Buffer::GetHeap() const {
     return mHeap;
 }
 
+size_t Buffer::GetOffset() const {
+    return mOffset;
+}
+
 MTL::Buffer *Buffer::GetBuffer() const {
     return mBuffer;
 }
 
 void Buffer::InitHeap(size_t size) {
-    auto descriptor = MTL::HeapDescriptor::alloc()->init();
-    assert(descriptor);
-
-    descriptor->setSize(size);
-    descriptor->setResourceOptions(convertToResourceOptions(mFlags));
-    descriptor->setType(MTL::HeapTypePlacement);
-
     auto device = mContext->GetDevice();
     assert(device);
 
-    mHeap = device->GetDevice()->newHeap(descriptor);
-    assert(mHeap);
-
-    descriptor->release();
+    mAllocation = device->GetBufferAllocator()->Allocate(convertToResourceOptions(mFlags), size);
+    mHeap = mAllocation.Heap;
+    mHeap->retain();
 }
 
 void Buffer::InitHeap() {
@@ -118,9 +142,22 @@ void Buffer::InitHeap() {
 void Buffer::InitBuffer(size_t size, size_t offset) {
     mBuffer = mHeap->newBuffer(size, mHeap->resourceOptions(), offset);
     assert(mBuffer);
+    mOffset = offset;
     mSize = mBuffer->allocatedSize();
 }
 
+void Buffer::InitBuffer(const void *data, size_t size) {
+    auto device = mContext->GetDevice();
+    assert(device);
+
+    auto pageSize = static_cast<size_t>(getpagesize());
+
+    mBuffer = device->GetDevice()->newBuffer(data, (size + pageSize - 1) / pageSize * pageSize,
+                                             convertToResourceOptions(mFlags), nullptr);
+    assert(mBuffer);
+    mSize = size;
+}
+
 void Buffer::InitData(const void *data, size_t size) {
     memcpy(mBuffer->contents(), data, size);
 }
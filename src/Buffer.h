@@ -19,6 +19,7 @@
 
 #include "Metal.hpp"
 #include "Memory.h"
+#include "BufferAllocator.h"
 
 namespace cml {
 
@@ -31,20 +32,22 @@ public:
     Buffer(Context *context, cl_mem_flags flags, const void *data, size_t size);
     Buffer(Buffer *parent, cl_mem_flags flags, const cl_buffer_region *region);
     ~Buffer() override;
-    void *Map() override;
-    void Unmap() override;
     Buffer *GetParent() const;
     MTL::Heap *GetHeap() const;
+    size_t GetOffset() const;
     MTL::Buffer *GetBuffer() const;
 
 private:
     Buffer *mParent;
+    BufferAllocation mAllocation;
     MTL::Heap *mHeap;
+    size_t mOffset;
     MTL::Buffer *mBuffer;
 
     void InitHeap(size_t size);
     void InitHeap();
     void InitBuffer(size_t size, size_t offset);
+    void InitBuffer(const void *data, size_t size);
     void InitData(const void *data, size_t size);
 };
 
@@ -0,0 +1,166 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include "BufferAllocator.h"
+
+#include <bit>
+#include <cassert>
+#include <algorithm>
+
+#include "Device.h"
+#include "Environment.h"
+
+namespace cml {
+
+constexpr uint64_t DefaultBufferHeapSize = 64 * 1024 * 1024;
+constexpr uint64_t MinBufferBlockSize = 256;
+
+BufferAllocator::BufferAllocator(Device *device)
+    : mDevice{device}, mHeapSize{std::bit_ceil(std::max(Environment::Read("CLMTL_BUFFER_HEAP_SIZE",
+                                                                               DefaultBufferHeapSize),
+                                                        MinBufferBlockSize))}
+    , mPools{}, mPendingFrees{}, mEpoch{0}, mOpenEpochs{}, mDedicatedHeapCount{0}, mMutex{} {
+}
+
+BufferAllocator::~BufferAllocator() {
+    for (auto &[options, blocks] : mPools) {
+        for (auto &block : blocks) {
+            block->Heap->release();
+        }
+    }
+}
+
+BufferAllocation BufferAllocator::Allocate(MTL::ResourceOptions options, size_t size) {
+    auto sizeAndAlign = mDevice->GetDevice()->heapBufferSizeAndAlign(size, options);
+    auto blockSize = std::max<uint64_t>(sizeAndAlign.size, sizeAndAlign.align);
+    std::lock_guard lock{mMutex};
+
+    // Large buffers would fragment the shared heaps, so they keep a heap of their own.
+    if (blockSize > mHeapSize / 4) {
+        mDedicatedHeapCount++;
+        return {CreateHeap(options, sizeAndAlign.size), 0, options};
+    }
+
+    ReclaimFrees();
+
+    auto &blocks = mPools[options];
+    uint64_t offset;
+
+    for (auto &block : blocks) {
+        if (block->Allocator.Allocate(blockSize, offset)) {
+            return {block->Heap, offset, options};
+        }
+    }
+
+    blocks.push_back(std::make_unique<Block>(Block{CreateHeap(options, mHeapSize),
+                                                   BuddyAllocator{mHeapSize, MinBufferBlockSize}}));
+
+    auto result = blocks.back()->Allocator.Allocate(blockSize, offset);
+    assert(result);
+
+    return {blocks.back()->Heap, offset, options};
+}
+
+void BufferAllocator::Free(const BufferAllocation &allocation) {
+    std::lock_guard lock{mMutex};
+
+    // Command buffers that started encoding before this point may still access the range, so its reuse waits for them.
+    mPendingFrees.push_back({allocation, mEpoch});
+    ReclaimFrees();
+}
+
+uint64_t BufferAllocator::OpenEpoch() {
+    std::lock_guard lock{mMutex};
+
+    mOpenEpochs.insert(++mEpoch);
+
+    return mEpoch;
+}
+
+void BufferAllocator::CloseEpoch(uint64_t epoch) {
+    std::lock_guard lock{mMutex};
+
+    mOpenEpochs.erase(mOpenEpochs.find(epoch));
+}
+
+BufferAllocatorStatistics BufferAllocator::GetStatistics() const {
+    std::lock_guard lock{mMutex};
+    BufferAllocatorStatistics statistics{};
+
+    statistics.DedicatedHeapCount = mDedicatedHeapCount;
+    statistics.PendingFreeCount = mPendingFrees.size();
+
+    for (auto &[options, blocks] : mPools) {
+        for (auto &block : blocks) {
+            statistics.HeapCount++;
+            statistics.ReservedSize += block->Allocator.GetSize();
+            statistics.UsedSize += block->Allocator.GetUsedSize();
+            statistics.LargestFreeSize = std::max(statistics.LargestFreeSize, block->Allocator.GetLargestFreeSize());
+        }
+    }
+
+    return statistics;
+}
+
+MTL::Heap *BufferAllocator::CreateHeap(MTL::ResourceOptions options, size_t size) {
+    auto descriptor = MTL::HeapDescriptor::alloc()->init();
+    assert(descriptor);
+
+    descriptor->setSize(size);
+    descriptor->setResourceOptions(options);
+    descriptor->setType(MTL::HeapTypePlacement);
+
+    auto heap = mDevice->GetDevice()->newHeap(descriptor);
+    assert(heap);
+
+    descriptor->release();
+
+    return heap;
+}
+
+void BufferAllocator::ReclaimFrees() {
+    auto oldestEpoch = mOpenEpochs.empty() ? mEpoch + 1 : *mOpenEpochs.begin();
+
+    while (!mPendingFrees.empty() && mPendingFrees.front().Epoch < oldestEpoch) {
+        ReleaseAllocation(mPendingFrees.front().Allocation);
+        mPendingFrees.pop_front();
+    }
+}
+
+void BufferAllocator::ReleaseAllocation(const BufferAllocation &allocation) {
+    auto &blocks = mPools[allocation.Options];
+    auto iterator = std::find_if(blocks.begin(), blocks.end(), [&allocation](auto &block) {
+        return block->Heap == allocation.Heap;
+    });
+
+    if (iterator == blocks.end()) {
+        allocation.Heap->release();
+        mDedicatedHeapCount--;
+        return;
+    }
+
+    (*iterator)->Allocator.Free(allocation.Offset);
+
+    // One empty heap per pool stays around, so a buffer freed and created in a loop doesn't create a heap each time.
+    if ((*iterator)->Allocator.IsEmpty() && std::count_if(blocks.begin(), blocks.end(), [](auto &block) {
+        return block->Allocator.IsEmpty();
+    }) > 1) {
+        (*iterator)->Heap->release();
+        blocks.erase(iterator);
+    }
+}
+
+} //namespace cml
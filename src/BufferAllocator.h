@@ -0,0 +1,86 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_BUFFER_ALLOCATOR_H
+#define CLMTL_BUFFER_ALLOCATOR_H
+
+#include <set>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include "Metal.hpp"
+#include "BuddyAllocator.h"
+
+namespace cml {
+
+class Device;
+
+struct BufferAllocation {
+    MTL::Heap *Heap;
+    uint64_t Offset;
+    MTL::ResourceOptions Options;
+};
+
+struct BufferAllocatorStatistics {
+    uint64_t HeapCount;
+    uint64_t DedicatedHeapCount;
+    uint64_t ReservedSize;
+    uint64_t UsedSize;
+    uint64_t LargestFreeSize;
+    uint64_t PendingFreeCount;
+};
+
+class BufferAllocator {
+public:
+    explicit BufferAllocator(Device *device);
+    ~BufferAllocator();
+    BufferAllocation Allocate(MTL::ResourceOptions options, size_t size);
+    void Free(const BufferAllocation &allocation);
+    uint64_t OpenEpoch();
+    void CloseEpoch(uint64_t epoch);
+    BufferAllocatorStatistics GetStatistics() const;
+
+private:
+    struct Block {
+        MTL::Heap *Heap;
+        BuddyAllocator Allocator;
+    };
+
+    struct PendingFree {
+        BufferAllocation Allocation;
+        uint64_t Epoch;
+    };
+
+    Device *mDevice;
+    uint64_t mHeapSize;
+    std::unordered_map<MTL::ResourceOptions, std::vector<std::unique_ptr<Block>>> mPools;
+    std::deque<PendingFree> mPendingFrees;
+    uint64_t mEpoch;
+    std::multiset<uint64_t> mOpenEpochs;
+    uint64_t mDedicatedHeapCount;
+    mutable std::mutex mMutex;
+
+    MTL::Heap *CreateHeap(MTL::ResourceOptions options, size_t size);
+    void ReclaimFrees();
+    void ReleaseAllocation(const BufferAllocation &allocation);
+};
+
+} //namespace cml
+
+#endif //CLMTL_BUFFER_ALLOCATOR_H
@@ -0,0 +1,148 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include "BuiltinLibrary.h"
+
+#include <cassert>
+
+#include "Device.h"
+
+namespace cml {
+
+constexpr auto BuiltinSource = R"(
+#include <metal_stdlib>
+
+using namespace metal;
+
+struct FillArguments {
+    ulong Offset;
+    ulong Size;
+    uint PeriodSize;
+};
+
+struct CopyRectArguments {
+    ulong SrcOffset;
+    ulong SrcRowPitch;
+    ulong SrcSlicePitch;
+    ulong DstOffset;
+    ulong DstRowPitch;
+    ulong DstSlicePitch;
+};
+
+// Each thread writes one 16 byte aligned chunk. The period holds the pattern rotated so that it starts at an aligned
+// address, which lets whole chunks be stored as a single vector and only the head and tail fall back to bytes.
+kernel void FillBuffer(device uchar *buffer [[buffer(0)]], constant uchar *period [[buffer(1)]],
+                       constant FillArguments &arguments [[buffer(2)]], uint index [[thread_position_in_grid]]) {
+    ulong begin = (arguments.Offset & ~15ul) + ulong(index) * 16;
+    ulong end = arguments.Offset + arguments.Size;
+
+    if (begin >= arguments.Offset && begin + 16 <= end) {
+        *(device uint4 *) (buffer + begin) = *(constant uint4 *) (period + begin % arguments.PeriodSize);
+    } else {
+        for (ulong i = max(begin, arguments.Offset); i < min(begin + 16, end); ++i) {
+            buffer[i] = period[i % arguments.PeriodSize];
+        }
+    }
+}
+
+// Copies one byte per thread, used for regions made of many short rows where a blit per row would cost more.
+kernel void CopyBufferRect(device const uchar *src [[buffer(0)]], device uchar *dst [[buffer(1)]],
+                           constant CopyRectArguments &arguments [[buffer(2)]],
+                           uint3 index [[thread_position_in_grid]]) {
+    dst[arguments.DstOffset + index.z * arguments.DstSlicePitch + index.y * arguments.DstRowPitch + index.x] =
+        src[arguments.SrcOffset + index.z * arguments.SrcSlicePitch + index.y * arguments.SrcRowPitch + index.x];
+}
+)";
+
+BuiltinLibrary::BuiltinLibrary(Device *device)
+    : mDevice{device}, mLibrary{nullptr}, mFillBufferPipelineState{nullptr}
+    , mCopyBufferRectPipelineState{nullptr}, mMutex{} {
+}
+
+BuiltinLibrary::~BuiltinLibrary() {
+    if (mFillBufferPipelineState) {
+        mFillBufferPipelineState->release();
+    }
+
+    if (mCopyBufferRectPipelineState) {
+        mCopyBufferRectPipelineState->release();
+    }
+
+    if (mLibrary) {
+        mLibrary->release();
+    }
+}
+
+MTL::ComputePipelineState *BuiltinLibrary::GetFillBufferPipelineState() {
+    std::lock_guard lock{mMutex};
+
+    if (!mFillBufferPipelineState) {
+        mFillBufferPipelineState = CreatePipelineState("FillBuffer");
+    }
+
+    return mFillBufferPipelineState;
+}
+
+MTL::ComputePipelineState *BuiltinLibrary::GetCopyBufferRectPipelineState() {
+    std::lock_guard lock{mMutex};
+
+    if (!mCopyBufferRectPipelineState) {
+        mCopyBufferRectPipelineState = CreatePipelineState("CopyBufferRect");
+    }
+
+    return mCopyBufferRectPipelineState;
+}
+
+void BuiltinLibrary::InitLibrary() {
+    auto source = NS::String::alloc()->init(BuiltinSource, NS::UTF8StringEncoding);
+    NS::Error *error = nullptr;
+
+    mLibrary = mDevice->GetDevice()->newLibrary(source, nullptr, &error);
+    assert(mLibrary);
+
+    source->release();
+
+    if (error) {
+        error->release();
+    }
+}
+
+MTL::ComputePipelineState *BuiltinLibrary::CreatePipelineState(const char *name) {
+    if (!mLibrary) {
+        InitLibrary();
+    }
+
+    auto functionName = NS::String::alloc()->init(name, NS::UTF8StringEncoding);
+    auto function = mLibrary->newFunction(functionName);
+    assert(function);
+
+    functionName->release();
+
+    NS::Error *error = nullptr;
+    auto pipelineState = mDevice->GetDevice()->newComputePipelineState(function, &error);
+
+    function->release();
+
+    if (error) {
+        error->release();
+
+        throw std::exception();
+    }
+
+    return pipelineState;
+}
+
+} //namespace cml
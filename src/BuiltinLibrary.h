@@ -0,0 +1,63 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_BUILTIN_LIBRARY_H
+#define CLMTL_BUILTIN_LIBRARY_H
+
+#include <mutex>
+
+#include "Metal.hpp"
+
+namespace cml {
+
+class Device;
+
+struct FillArguments {
+    uint64_t Offset;
+    uint64_t Size;
+    uint32_t PeriodSize;
+};
+
+struct CopyRectArguments {
+    uint64_t SrcOffset;
+    uint64_t SrcRowPitch;
+    uint64_t SrcSlicePitch;
+    uint64_t DstOffset;
+    uint64_t DstRowPitch;
+    uint64_t DstSlicePitch;
+};
+
+class BuiltinLibrary {
+public:
+    explicit BuiltinLibrary(Device *device);
+    ~BuiltinLibrary();
+    MTL::ComputePipelineState *GetFillBufferPipelineState();
+    MTL::ComputePipelineState *GetCopyBufferRectPipelineState();
+
+private:
+    Device *mDevice;
+    MTL::Library *mLibrary;
+    MTL::ComputePipelineState *mFillBufferPipelineState;
+    MTL::ComputePipelineState *mCopyBufferRectPipelineState;
+    std::mutex mMutex;
+
+    void InitLibrary();
+    MTL::ComputePipelineState *CreatePipelineState(const char *name);
+};
+
+} //namespace cml
+
+#endif //CLMTL_BUILTIN_LIBRARY_H
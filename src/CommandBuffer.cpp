@@ -0,0 +1,319 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include "CommandBuffer.h"
+
+#ifdef cl_khr_command_buffer
+
+#include <cassert>
+#include <algorithm>
+
+#include "Dispatch.h"
+#include "CommandQueue.h"
+#include "Buffer.h"
+#include "Image.h"
+#include "Sampler.h"
+
+namespace cml {
+
+void RetainArgs(const std::unordered_map<uint32_t, Arg> &argTable) {
+    for (auto &[index, arg] : argTable) {
+        switch (arg.Kind) {
+            case clspv::ArgKind::Buffer:
+            case clspv::ArgKind::BufferUBO:
+                if (arg.Buffer) {
+                    Buffer::DownCast(arg.Buffer)->Retain();
+                }
+                break;
+            case clspv::ArgKind::SampledImage:
+            case clspv::ArgKind::StorageImage:
+                if (arg.Image) {
+                    Image::DownCast(arg.Image)->Retain();
+                }
+                break;
+            case clspv::ArgKind::Sampler:
+                if (arg.Sampler) {
+                    Sampler::DownCast(arg.Sampler)->Retain();
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void ReleaseMemory(Memory *memory) {
+    if (!memory->Release()) {
+        delete memory;
+    }
+}
+
+void ReleaseSampler(Sampler *sampler) {
+    if (!sampler->Release()) {
+        delete sampler;
+    }
+}
+
+void ReleaseArgs(const std::unordered_map<uint32_t, Arg> &argTable) {
+    for (auto &[index, arg] : argTable) {
+        switch (arg.Kind) {
+            case clspv::ArgKind::Buffer:
+            case clspv::ArgKind::BufferUBO:
+                if (arg.Buffer) {
+                    ReleaseMemory(Buffer::DownCast(arg.Buffer));
+                }
+                break;
+            case clspv::ArgKind::SampledImage:
+            case clspv::ArgKind::StorageImage:
+                if (arg.Image) {
+                    ReleaseMemory(Image::DownCast(arg.Image));
+                }
+                break;
+            case clspv::ArgKind::Sampler:
+                if (arg.Sampler) {
+                    ReleaseSampler(Sampler::DownCast(arg.Sampler));
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+CommandBuffer *CommandBuffer::DownCast(cl_command_buffer_khr commandBuffer) {
+    return (CommandBuffer *) commandBuffer;
+}
+
+CommandBuffer::CommandBuffer(CommandQueue *commandQueue)
+    : _cl_command_buffer_khr{Dispatch::GetTable()}, Object{}, mCommandQueue{commandQueue}
+    , mState{CL_COMMAND_BUFFER_STATE_RECORDING_KHR}, mCommands{}, mBarrierSyncPoint{0} {
+    mCommandQueue->Retain();
+}
+
+CommandBuffer::~CommandBuffer() {
+    for (auto &command : mCommands) {
+        switch (command->Type) {
+            case CommandType::CopyBuffer:
+                ReleaseMemory(command->SrcBuffer);
+                ReleaseMemory(command->DstBuffer);
+                break;
+            case CommandType::FillBuffer:
+                ReleaseMemory(command->DstBuffer);
+                break;
+            case CommandType::Dispatch:
+                ReleaseArgs(command->ArgTable);
+                command->PipelineState->release();
+
+                if (!command->Kernel->Release()) {
+                    delete command->Kernel;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (!mCommandQueue->Release()) {
+        delete mCommandQueue;
+    }
+}
+
+cl_sync_point_khr CommandBuffer::AddCopyBuffer(Buffer *srcBuffer, size_t srcOffset, Buffer *dstBuffer,
+                                               size_t dstOffset, size_t size,
+                                               std::span<const cl_sync_point_khr> waitList) {
+    auto command = AddCommand(CommandType::CopyBuffer, waitList);
+
+    srcBuffer->Retain();
+    dstBuffer->Retain();
+
+    command->SrcBuffer = srcBuffer;
+    command->SrcOffset = srcOffset;
+    command->DstBuffer = dstBuffer;
+    command->DstOffset = dstOffset;
+    command->Size = size;
+
+    return GetSyncPointCount();
+}
+
+cl_sync_point_khr CommandBuffer::AddFillBuffer(const void *srcData, size_t srcSize, Buffer *dstBuffer,
+                                               size_t dstOffset, size_t dstSize,
+                                               std::span<const cl_sync_point_khr> waitList) {
+    auto command = AddCommand(CommandType::FillBuffer, waitList);
+
+    dstBuffer->Retain();
+
+    command->Pattern.assign(static_cast<const uint8_t *>(srcData), static_cast<const uint8_t *>(srcData) + srcSize);
+    command->DstBuffer = dstBuffer;
+    command->DstOffset = dstOffset;
+    command->Size = dstSize;
+
+    return GetSyncPointCount();
+}
+
+cl_sync_point_khr CommandBuffer::AddDispatch(Kernel *kernel, const Size &globalWorkSize, const Size &localWorkSize,
+                                             std::span<const cl_sync_point_khr> waitList) {
+    auto command = AddCommand(CommandType::Dispatch, waitList);
+
+    // Resolve the pipeline and snapshot the arguments now so replay only has to bind and dispatch.
+    auto workGroupSize = localWorkSize.w ? localWorkSize : kernel->GetDefaultWorkGroupSize();
+    auto pipelineState = kernel->GetPipelineState(workGroupSize);
+
+    kernel->Retain();
+    pipelineState->retain();
+    RetainArgs(kernel->GetArgTable());
+
+    command->Kernel = kernel;
+    command->PipelineState = pipelineState;
+    command->ArgTable = kernel->GetArgTable();
+    command->GlobalWorkSize = globalWorkSize;
+    command->WorkGroupSize = workGroupSize;
+
+    return GetSyncPointCount();
+}
+
+cl_sync_point_khr CommandBuffer::AddBarrier(std::span<const cl_sync_point_khr> waitList) {
+    AddCommand(CommandType::Barrier, waitList);
+
+    return GetSyncPointCount();
+}
+
+void CommandBuffer::Finalize() {
+    mState = CL_COMMAND_BUFFER_STATE_EXECUTABLE_KHR;
+}
+
+void CommandBuffer::Enqueue(CommandQueue *commandQueue) {
+    assert(mState == CL_COMMAND_BUFFER_STATE_EXECUTABLE_KHR);
+
+    for (auto &command : mCommands) {
+        if (command->Barrier) {
+            commandQueue->EnqueueBarrier();
+        }
+
+        switch (command->Type) {
+            case CommandType::CopyBuffer:
+                commandQueue->EnqueueCopyBuffer(command->SrcBuffer, command->SrcOffset, command->DstBuffer,
+                                                command->DstOffset, command->Size);
+                break;
+            case CommandType::FillBuffer:
+                commandQueue->EnqueueFillBuffer(command->Pattern.data(), command->Pattern.size(), command->DstBuffer,
+                                                command->DstOffset, command->Size);
+                break;
+            case CommandType::Dispatch:
+                commandQueue->EnqueueDispatch(command->PipelineState, command->ArgTable, command->GlobalWorkSize,
+                                              command->WorkGroupSize);
+                break;
+            case CommandType::Barrier:
+                break;
+        }
+    }
+}
+
+cl_int CommandBuffer::UpdateArg(Command *command, cl_uint index, const void *data, size_t size) {
+    if (command->Type != CommandType::Dispatch) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (!command->ArgTable.contains(index)) {
+        return CL_INVALID_ARG_INDEX;
+    }
+
+    auto &arg = command->ArgTable.at(index);
+
+    switch (arg.Kind) {
+        case clspv::ArgKind::Buffer:
+        case clspv::ArgKind::BufferUBO: {
+            if (size != sizeof(cl_mem)) {
+                return CL_INVALID_ARG_SIZE;
+            }
+
+            auto buffer = data ? *static_cast<const cl_mem *>(data) : nullptr;
+
+            if (buffer) {
+                Buffer::DownCast(buffer)->Retain();
+            }
+
+            if (arg.Buffer) {
+                ReleaseMemory(Buffer::DownCast(arg.Buffer));
+            }
+
+            arg.Buffer = buffer;
+            return CL_SUCCESS;
+        }
+        case clspv::ArgKind::Pod:
+        case clspv::ArgKind::PodUBO:
+        case clspv::ArgKind::PodPushConstant:
+            // The recorded dispatch was encoded for the recorded layout, so the size can't change.
+            if (size != arg.Size) {
+                return CL_INVALID_VALUE;
+            }
+
+            if (!data) {
+                return CL_INVALID_ARG_VALUE;
+            }
+
+            memcpy(arg.Data, data, size);
+            return CL_SUCCESS;
+        default:
+            return CL_INVALID_ARG_VALUE;
+    }
+}
+
+bool CommandBuffer::HasCommand(const Command *command) const {
+    return std::any_of(mCommands.begin(), mCommands.end(), [command](const std::unique_ptr<Command> &ownCommand) {
+        return ownCommand.get() == command;
+    });
+}
+
+CommandQueue *CommandBuffer::GetCommandQueue() const {
+    return mCommandQueue;
+}
+
+cl_command_buffer_state_khr CommandBuffer::GetState() const {
+    return mState;
+}
+
+Command *CommandBuffer::GetLastCommand() const {
+    return mCommands.back().get();
+}
+
+cl_sync_point_khr CommandBuffer::GetSyncPointCount() const {
+    return mCommands.size();
+}
+
+Command *CommandBuffer::AddCommand(CommandType type, std::span<const cl_sync_point_khr> waitList) {
+    assert(mState == CL_COMMAND_BUFFER_STATE_RECORDING_KHR);
+
+    auto command = std::make_unique<Command>();
+    auto syncPoint = waitList.empty() ? 0 : *std::max_element(waitList.begin(), waitList.end());
+
+    command->Dispatch = Dispatch::GetTable();
+    command->Type = type;
+
+    // A barrier on replay orders the command after every earlier one. It is only needed when the command waits for a
+    // sync point that the last barrier doesn't cover yet.
+    command->Barrier = type == CommandType::Barrier || syncPoint > mBarrierSyncPoint;
+
+    if (command->Barrier) {
+        mBarrierSyncPoint = GetSyncPointCount();
+    }
+    mCommands.push_back(std::move(command));
+
+    return mCommands.back().get();
+}
+
+} //namespace cml
+
+#endif //cl_khr_command_buffer
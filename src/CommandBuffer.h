@@ -0,0 +1,114 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_COMMAND_BUFFER_H
+#define CLMTL_COMMAND_BUFFER_H
+
+#include <memory>
+#include <vector>
+#include <span>
+#include <unordered_map>
+#include <CL/cl_icd.h>
+
+#include "Metal.hpp"
+#include "Size.h"
+#include "Object.h"
+#include "Kernel.h"
+#include "Extension.h"
+
+#ifdef cl_khr_command_buffer
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct _cl_command_buffer_khr {
+    cl_icd_dispatch *Dispatch;
+};
+
+struct _cl_mutable_command_khr {
+    cl_icd_dispatch *Dispatch;
+};
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
+
+namespace cml {
+
+class CommandQueue;
+class Buffer;
+
+enum class CommandType {
+    CopyBuffer,
+    FillBuffer,
+    Dispatch,
+    Barrier
+};
+
+struct Command : public _cl_mutable_command_khr {
+    CommandType Type;
+    bool Barrier;
+    Buffer *SrcBuffer;
+    size_t SrcOffset;
+    Buffer *DstBuffer;
+    size_t DstOffset;
+    size_t Size;
+    std::vector<uint8_t> Pattern;
+    cml::Kernel *Kernel;
+    MTL::ComputePipelineState *PipelineState;
+    std::unordered_map<uint32_t, Arg> ArgTable;
+    cml::Size GlobalWorkSize;
+    cml::Size WorkGroupSize;
+};
+
+class CommandBuffer : public _cl_command_buffer_khr, public Object {
+public:
+    static CommandBuffer *DownCast(cl_command_buffer_khr commandBuffer);
+
+public:
+    explicit CommandBuffer(CommandQueue *commandQueue);
+    ~CommandBuffer() override;
+    cl_sync_point_khr AddCopyBuffer(Buffer *srcBuffer, size_t srcOffset, Buffer *dstBuffer, size_t dstOffset,
+                                    size_t size, std::span<const cl_sync_point_khr> waitList);
+    cl_sync_point_khr AddFillBuffer(const void *srcData, size_t srcSize, Buffer *dstBuffer, size_t dstOffset,
+                                    size_t dstSize, std::span<const cl_sync_point_khr> waitList);
+    cl_sync_point_khr AddDispatch(Kernel *kernel, const Size &globalWorkSize, const Size &localWorkSize,
+                                  std::span<const cl_sync_point_khr> waitList);
+    cl_sync_point_khr AddBarrier(std::span<const cl_sync_point_khr> waitList);
+    void Finalize();
+    void Enqueue(CommandQueue *commandQueue);
+    cl_int UpdateArg(Command *command, cl_uint index, const void *data, size_t size);
+    bool HasCommand(const Command *command) const;
+    CommandQueue *GetCommandQueue() const;
+    cl_command_buffer_state_khr GetState() const;
+    Command *GetLastCommand() const;
+    cl_sync_point_khr GetSyncPointCount() const;
+
+private:
+    CommandQueue *mCommandQueue;
+    cl_command_buffer_state_khr mState;
+    std::vector<std::unique_ptr<Command>> mCommands;
+    cl_sync_point_khr mBarrierSyncPoint;
+
+    Command *AddCommand(CommandType type, std::span<const cl_sync_point_khr> waitList);
+};
+
+} //namespace cml
+
+#endif //cl_khr_command_buffer
+
+#endif //CLMTL_COMMAND_BUFFER_H
@@ -0,0 +1,79 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_COMMAND_BUFFER_RETIRER_H
+#define CLMTL_COMMAND_BUFFER_RETIRER_H
+
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+
+namespace cml {
+
+// Holds committed command buffers until they complete. Command buffers complete in submission order, so only the
+// oldest ones are checked, and releasing them frees their completion handlers and everything the handlers captured.
+// Completion is checked through the traits, which lets the tests stand in for Metal.
+template<typename Traits>
+class CommandBufferRetirer {
+public:
+    using CommandBuffer = typename Traits::CommandBuffer;
+
+public:
+    CommandBufferRetirer()
+        : mCommandBuffers{}, mMaxCount{0} {
+    }
+
+    void Push(CommandBuffer *commandBuffer) {
+        mCommandBuffers.push_back(commandBuffer);
+        mMaxCount = std::max<uint64_t>(mMaxCount, mCommandBuffers.size());
+    }
+
+    uint64_t Retire() {
+        uint64_t count = 0;
+
+        while (!mCommandBuffers.empty() && Traits::IsCompleted(mCommandBuffers.front())) {
+            Traits::Release(mCommandBuffers.front());
+            mCommandBuffers.pop_front();
+            count++;
+        }
+
+        return count;
+    }
+
+    std::deque<CommandBuffer *> Take() {
+        std::deque<CommandBuffer *> commandBuffers;
+
+        commandBuffers.swap(mCommandBuffers);
+
+        return commandBuffers;
+    }
+
+    uint64_t GetCount() const {
+        return mCommandBuffers.size();
+    }
+
+    uint64_t GetMaxCount() const {
+        return mMaxCount;
+    }
+
+private:
+    std::deque<CommandBuffer *> mCommandBuffers;
+    uint64_t mMaxCount;
+};
+
+} //namespace cml
+
+#endif //CLMTL_COMMAND_BUFFER_RETIRER_H
@@ -16,8 +16,13 @@
 
 #include "CommandQueue.h"
 
+#include <cstdio>
+#include <algorithm>
+#include <bit>
+
 #include "Dispatch.h"
 #include "Util.h"
+#include "Environment.h"
 #include "Context.h"
 #include "Device.h"
 #include "Buffer.h"
@@ -25,6 +30,8 @@
 #include "Kernel.h"
 #include "Event.h"
 #include "Sampler.h"
+#include "BufferAllocator.h"
+#include "BuiltinLibrary.h"
 
 namespace cml {
 
@@ -36,8 +43,160 @@ MTL::Size ConvertToSize(const Size &size) {
     return MTL::Size::Make(size.w, std::max(size.h, 1lu), std::max(size.d, 1lu));
 }
 
-void BindResources(MTL::ComputeCommandEncoder *commandEncoder, Kernel *kernel) {
-    for (auto &[index, arg]: kernel->GetArgTable()) {
+uint64_t GetVolume(const Size &size) {
+    return size.w * std::max(size.h, 1lu) * std::max(size.d, 1lu);
+}
+
+struct ImageSlices {
+    MTL::Origin SliceOrigin;
+    MTL::Size SliceSize;
+    size_t FirstSlice;
+    size_t SliceCount;
+};
+
+ImageSlices GetImageSlices(Image *image, const Origin &origin, const Size &region) {
+    // Blits address the layers of an array texture by slice, so the layer coordinate is split off the region.
+    switch (image->GetType()) {
+        case CL_MEM_OBJECT_IMAGE1D_ARRAY:
+            return {MTL::Origin::Make(origin.x, 0, 0), MTL::Size::Make(region.w, 1, 1), origin.y,
+                    std::max(region.h, 1lu)};
+        case CL_MEM_OBJECT_IMAGE2D_ARRAY:
+            return {MTL::Origin::Make(origin.x, origin.y, 0), MTL::Size::Make(region.w, std::max(region.h, 1lu), 1),
+                    origin.z, std::max(region.d, 1lu)};
+        default:
+            return {ConvertToOrigin(origin), ConvertToSize(region), 0, 1};
+    }
+}
+
+const void *GetAliasKey(MTL::Resource *resource) {
+    auto heap = resource->heap();
+
+    return heap ? static_cast<const void *>(heap) : static_cast<const void *>(resource);
+}
+
+const void *GetAliasKey(Buffer *buffer) {
+    // Heaps are shared by unrelated buffers, so sub-buffers are identified by their root buffer instead.
+    while (buffer->GetParent()) {
+        buffer = buffer->GetParent();
+    }
+
+    return buffer->GetBuffer();
+}
+
+void CollectResources(const std::unordered_map<uint32_t, Arg> &argTable, std::vector<const void *> &reads,
+                      std::vector<const void *> &writes) {
+    for (auto &[index, arg]: argTable) {
+        switch (arg.Kind) {
+            case clspv::ArgKind::Buffer: {
+                auto buffer = Buffer::DownCast(arg.Buffer);
+
+                if (Util::TestAnyFlagSet(buffer->GetFlags(), CL_MEM_READ_ONLY)) {
+                    reads.push_back(GetAliasKey(buffer));
+                } else {
+                    writes.push_back(GetAliasKey(buffer));
+                }
+                break;
+            }
+            case clspv::ArgKind::BufferUBO:
+                reads.push_back(GetAliasKey(Buffer::DownCast(arg.Buffer)));
+                break;
+            case clspv::ArgKind::SampledImage:
+                reads.push_back(GetAliasKey(Image::DownCast(arg.Image)->GetTexture()));
+                break;
+            case clspv::ArgKind::StorageImage:
+                writes.push_back(GetAliasKey(Image::DownCast(arg.Image)->GetTexture()));
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+constexpr uint64_t DefaultStagingRingSize = 16 * 1024 * 1024;
+constexpr size_t FillChunkSize = 16;
+constexpr size_t MaxComputeCopySpanSize = 256;
+constexpr MTL::ResourceOptions MapStagingOptions = MTL::ResourceStorageModeShared |
+                                                   MTL::ResourceHazardTrackingModeTracked;
+
+size_t GetOffset(const Origin &origin, size_t rowPitch, size_t slicePitch) {
+    return origin.z * slicePitch + origin.y * rowPitch + origin.x;
+}
+
+size_t GetSpanSize(const Size &region, size_t srcRowPitch, size_t srcSlicePitch, size_t dstRowPitch,
+                   size_t dstSlicePitch) {
+    auto sliceSize = region.w * region.h;
+
+    // Rows without padding on both sides are merged into slices, and such slices into a single span.
+    if (region.h > 1 && (srcRowPitch != region.w || dstRowPitch != region.w)) {
+        return region.w;
+    }
+
+    if (region.d > 1 && (srcSlicePitch != sliceSize || dstSlicePitch != sliceSize)) {
+        return sliceSize;
+    }
+
+    return sliceSize * region.d;
+}
+
+template<typename Function>
+void ForEachSpan(const Size &region, size_t spanSize, size_t srcRowPitch, size_t srcSlicePitch, size_t dstRowPitch,
+                 size_t dstSlicePitch, Function function) {
+    auto rowCount = spanSize < region.w * region.h ? region.h : 1;
+    auto sliceCount = spanSize < region.w * region.h * region.d ? region.d : 1;
+
+    for (size_t z = 0; z != sliceCount; ++z) {
+        for (size_t y = 0; y != rowCount; ++y) {
+            function(z * srcSlicePitch + y * srcRowPitch, z * dstSlicePitch + y * dstRowPitch);
+        }
+    }
+}
+
+void CopyRect(const uint8_t *srcData, size_t srcRowPitch, size_t srcSlicePitch, uint8_t *dstData, size_t dstRowPitch,
+              size_t dstSlicePitch, const Size &region) {
+    auto spanSize = GetSpanSize(region, srcRowPitch, srcSlicePitch, dstRowPitch, dstSlicePitch);
+
+    ForEachSpan(region, spanSize, srcRowPitch, srcSlicePitch, dstRowPitch, dstSlicePitch,
+                [=](size_t srcOffset, size_t dstOffset) {
+                    memcpy(dstData + dstOffset, srcData + srcOffset, spanSize);
+                });
+}
+
+bool IsUniformPattern(const void *pattern, size_t patternSize) {
+    auto data = static_cast<const uint8_t *>(pattern);
+
+    return std::all_of(data, data + patternSize, [data](uint8_t value) {
+        return value == data[0];
+    });
+}
+
+void FillPattern(uint8_t *data, size_t size, const void *pattern, size_t patternSize) {
+    auto filledSize = std::min(size, patternSize);
+
+    memcpy(data, pattern, filledSize);
+
+    // Each copy doubles the filled prefix, so the pattern is replicated in a logarithmic number of copies.
+    while (filledSize < size) {
+        auto copySize = std::min(filledSize, size - filledSize);
+
+        memcpy(data + filledSize, data, copySize);
+        filledSize += copySize;
+    }
+}
+
+FlushPolicy ReadFlushPolicy() {
+    return {.CommandCount = Environment::Read("CLMTL_FLUSH_COMMAND_COUNT", 512),
+            .ByteCount = Environment::Read("CLMTL_FLUSH_BYTE_COUNT", 64 * 1024 * 1024),
+            .WorkCount = Environment::Read("CLMTL_FLUSH_WORK_COUNT", 64 * 1024 * 1024),
+            .Interval = Environment::Read("CLMTL_FLUSH_INTERVAL", 2000),
+            .IdleCommandCount = Environment::Read("CLMTL_FLUSH_IDLE_COMMAND_COUNT", 16)};
+}
+
+double GetSeconds(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration<double>(time.time_since_epoch()).count();
+}
+
+void BindResources(MTL::ComputeCommandEncoder *commandEncoder, const std::unordered_map<uint32_t, Arg> &argTable) {
+    for (auto &[index, arg]: argTable) {
         switch (arg.Kind) {
             case clspv::ArgKind::Buffer:
                 commandEncoder->setBuffer(Buffer::DownCast(arg.Buffer)->GetBuffer(), 0, arg.Binding);
@@ -58,141 +217,489 @@ void BindResources(MTL::ComputeCommandEncoder *commandEncoder, Kernel *kernel) {
     }
 }
 
+MTL::CommandEncoder *MetalEncoderTraits::Begin(MTL::CommandBuffer *commandBuffer, EncoderType type) {
+    if (type == EncoderType::Blit) {
+        return commandBuffer->blitCommandEncoder();
+    } else {
+        return commandBuffer->computeCommandEncoder(MTL::DispatchTypeConcurrent);
+    }
+}
+
+void MetalEncoderTraits::End(MTL::CommandEncoder *encoder) {
+    encoder->endEncoding();
+    encoder->release();
+}
+
+bool MetalRetireTraits::IsCompleted(MTL::CommandBuffer *commandBuffer) {
+    auto status = commandBuffer->status();
+
+    return status == MTL::CommandBufferStatusCompleted || status == MTL::CommandBufferStatusError;
+}
+
+void MetalRetireTraits::Release(MTL::CommandBuffer *commandBuffer) {
+    commandBuffer->release();
+}
+
 CommandQueue *CommandQueue::DownCast(cl_command_queue commandQueue) {
     return (CommandQueue *) commandQueue;
 }
 
 CommandQueue::CommandQueue(Context *context, Device *device, cl_command_queue_properties properties)
-    : _cl_command_queue{Dispatch::GetTable()}, Object{}, mContext{context}, mDevice{device}, mProperties{properties}
-    , mCommandQueue{}, mCommandBuffer{}, mCommittedCommandBuffer{} {
+    : _cl_command_queue{Dispatch::GetTable()}, Object{}, mContext{context}, mDevice{device}
+    , mStagingRing{device->GetDevice(), Environment::Read("CLMTL_STAGING_RING_SIZE", DefaultStagingRingSize)}
+    , mUnifiedMemory{device->GetDevice()->hasUnifiedMemory()}, mProperties{properties}, mCommandQueue{}, mTimeline{}
+    , mCommandBuffer{}, mEncoder{}, mSerial{0}, mEvents{}, mStagingBuffers{}, mCompletedSerial{0}
+    , mHostTimeline{}, mHostSerial{0}, mWaitCount{0}, mHazardTracker{}, mReads{}, mWrites{}
+    , mCommandCount{0}, mByteCount{0}, mWorkCount{0}, mFirstCommandTime{}, mEpoch{0}
+    , mFlushPolicy{ReadFlushPolicy()}, mInFlightCount{0}, mInFlightMutex{}, mInFlightCondition{}, mStatistics{}
+    , mStatisticsMutex{}, mCommittedCommandBuffers{}
+    , mLastCommandBuffer{nullptr}
+    , mMutex{} {
     InitCommandQueue();
+    InitTimeline();
     InitCommandBuffer();
 }
 
 CommandQueue::~CommandQueue() {
+    // Releasing a queue implicitly flushes it, otherwise its pending events would never complete and the buffer
+    // allocator epoch opened by its first command would never close.
+    {
+        std::lock_guard lock{mMutex};
+
+        if (mCommandCount || !mEvents.empty() || mWaitCount) {
+            Commit(false);
+        } else {
+            EndEncoding();
+        }
+    }
+
     WaitIdle();
+
+    // A command buffer completes before its handlers run, and the handlers still touch the queue.
+    {
+        std::unique_lock lock{mInFlightMutex};
+
+        mInFlightCondition.wait(lock, [this]() {
+            return !mInFlightCount;
+        });
+    }
+
+    if (mLastCommandBuffer) {
+        mLastCommandBuffer->release();
+    }
+
     mCommandBuffer->release();
+    mHostTimeline->release();
+    mTimeline->release();
     mCommandQueue->release();
+
+    if (Environment::Read("CLMTL_QUEUE_STATISTICS", 0)) {
+        PrintStatistics();
+    }
 }
 
-void CommandQueue::EnqueueReadBuffer(Buffer *srcBuffer, size_t srcOffset, void *dstData, size_t dstSize) {
-    auto commandEncoder = mCommandBuffer->blitCommandEncoder();
-    assert(commandEncoder);
+void CommandQueue::EnqueueReadBuffer(Buffer *srcBuffer, size_t srcOffset, void *dstData, size_t dstSize,
+                                     bool blocking) {
+    if (IsHostAccessible(srcBuffer)) {
+        auto srcData = static_cast<uint8_t *>(srcBuffer->GetBuffer()->contents()) + srcOffset;
 
-    auto dstBuffer = new Buffer(mContext, CL_MEM_ALLOC_HOST_PTR, dstSize);
-    assert(dstBuffer);
+        EnqueueHostCopy([=]() {
+            memcpy(dstData, srcData, dstSize);
+        }, blocking);
+        return;
+    }
+
+    std::lock_guard lock{mMutex};
+    auto dstAllocation = AllocateStaging(dstSize);
+    auto commandEncoder = GetBlitCommandEncoder();
 
-    commandEncoder->copyFromBuffer(srcBuffer->GetBuffer(), srcOffset, dstBuffer->GetBuffer(), 0, dstSize);
-    commandEncoder->endEncoding();
-    commandEncoder->release();
-    mCommandBuffer->addCompletedHandler([dstData, dstBuffer](MTL::CommandBuffer *commandBuffer) {
-        memcpy(dstData, dstBuffer->Map(), dstBuffer->GetSize());
-        dstBuffer->Unmap();
-        dstBuffer->Release();
-        delete dstBuffer;
+    commandEncoder->copyFromBuffer(srcBuffer->GetBuffer(), srcOffset, dstAllocation.Buffer, dstAllocation.Offset,
+                                   dstSize);
+    mCommandBuffer->addCompletedHandler([dstData, dstAllocation, dstSize](MTL::CommandBuffer *commandBuffer) {
+        memcpy(dstData, dstAllocation.Data, dstSize);
     });
+
+    AddWork(dstSize, 0);
 }
 
-void CommandQueue::EnqueueWriteBuffer(const void *srcData, Buffer *dstBuffer, size_t offset, size_t size) {
-    auto commandEncoder = mCommandBuffer->blitCommandEncoder();
-    assert(commandEncoder);
+void CommandQueue::EnqueueWriteBuffer(const void *srcData, Buffer *dstBuffer, size_t offset, size_t size,
+                                      bool blocking) {
+    if (IsHostAccessible(dstBuffer)) {
+        auto dstData = static_cast<uint8_t *>(dstBuffer->GetBuffer()->contents()) + offset;
+
+        EnqueueHostCopy([=]() {
+            memcpy(dstData, srcData, size);
+        }, blocking);
+        return;
+    }
+
+    std::lock_guard lock{mMutex};
+    auto srcAllocation = AllocateStaging(size);
+    auto commandEncoder = GetBlitCommandEncoder();
 
-    auto srcBuffer = new Buffer(mContext, CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR, srcData, size);
-    assert(srcBuffer);
+    memcpy(srcAllocation.Data, srcData, size);
+    commandEncoder->copyFromBuffer(srcAllocation.Buffer, srcAllocation.Offset, dstBuffer->GetBuffer(), offset, size);
 
-    commandEncoder->copyFromBuffer(srcBuffer->GetBuffer(), 0, dstBuffer->GetBuffer(), offset, size);
-    commandEncoder->endEncoding();
-    commandEncoder->release();
-    mCommandBuffer->addCompletedHandler([srcBuffer](MTL::CommandBuffer *commandBuffer) {
-        srcBuffer->Release();
-        delete srcBuffer;
+    AddWork(size, 0);
+}
+
+void CommandQueue::EnqueueReadBufferRect(Buffer *srcBuffer, const Origin &srcOrigin, size_t srcRowPitch,
+                                         size_t srcSlicePitch, void *dstData, const Origin &dstOrigin,
+                                         size_t dstRowPitch, size_t dstSlicePitch, const Size &region, bool blocking) {
+    auto srcOffset = GetOffset(srcOrigin, srcRowPitch, srcSlicePitch);
+    auto dst = static_cast<uint8_t *>(dstData) + GetOffset(dstOrigin, dstRowPitch, dstSlicePitch);
+
+    if (IsHostAccessible(srcBuffer)) {
+        auto src = static_cast<const uint8_t *>(srcBuffer->GetBuffer()->contents()) + srcOffset;
+
+        EnqueueHostCopy([=]() {
+            CopyRect(src, srcRowPitch, srcSlicePitch, dst, dstRowPitch, dstSlicePitch, region);
+        }, blocking);
+        return;
+    }
+
+    // The region is packed in staging, so the device side copy merges as many rows as the buffer layout allows.
+    auto rowPitch = region.w;
+    auto slicePitch = region.w * region.h;
+    auto size = GetVolume(region);
+    std::lock_guard lock{mMutex};
+    auto dstAllocation = AllocateStaging(size);
+
+    EncodeCopyRect(srcBuffer->GetBuffer(), GetAliasKey(srcBuffer), srcOffset, srcRowPitch, srcSlicePitch,
+                   dstAllocation.Buffer, GetAliasKey(dstAllocation.Buffer), dstAllocation.Offset, rowPitch, slicePitch,
+                   region);
+    mCommandBuffer->addCompletedHandler([=](MTL::CommandBuffer *commandBuffer) {
+        CopyRect(dstAllocation.Data, rowPitch, slicePitch, dst, dstRowPitch, dstSlicePitch, region);
     });
+
+    AddWork(size, 0);
+}
+
+void CommandQueue::EnqueueWriteBufferRect(const void *srcData, const Origin &srcOrigin, size_t srcRowPitch,
+                                          size_t srcSlicePitch, Buffer *dstBuffer, const Origin &dstOrigin,
+                                          size_t dstRowPitch, size_t dstSlicePitch, const Size &region,
+                                          bool blocking) {
+    auto src = static_cast<const uint8_t *>(srcData) + GetOffset(srcOrigin, srcRowPitch, srcSlicePitch);
+    auto dstOffset = GetOffset(dstOrigin, dstRowPitch, dstSlicePitch);
+
+    if (IsHostAccessible(dstBuffer)) {
+        auto dst = static_cast<uint8_t *>(dstBuffer->GetBuffer()->contents()) + dstOffset;
+
+        EnqueueHostCopy([=]() {
+            CopyRect(src, srcRowPitch, srcSlicePitch, dst, dstRowPitch, dstSlicePitch, region);
+        }, blocking);
+        return;
+    }
+
+    auto rowPitch = region.w;
+    auto slicePitch = region.w * region.h;
+    auto size = GetVolume(region);
+    std::lock_guard lock{mMutex};
+    auto srcAllocation = AllocateStaging(size);
+
+    CopyRect(src, srcRowPitch, srcSlicePitch, srcAllocation.Data, rowPitch, slicePitch, region);
+    EncodeCopyRect(srcAllocation.Buffer, GetAliasKey(srcAllocation.Buffer), srcAllocation.Offset, rowPitch,
+                   slicePitch, dstBuffer->GetBuffer(), GetAliasKey(dstBuffer), dstOffset, dstRowPitch, dstSlicePitch,
+                   region);
+
+    AddWork(size, 0);
 }
 
 void CommandQueue::EnqueueCopyBuffer(Buffer *srcBuffer, size_t srcOffset, Buffer *dstBuffer, size_t dstOffset,
                                      size_t size) {
-    auto commandEncoder = mCommandBuffer->blitCommandEncoder();
-    assert(commandEncoder);
+    std::lock_guard lock{mMutex};
+    auto commandEncoder = GetBlitCommandEncoder();
 
     commandEncoder->copyFromBuffer(srcBuffer->GetBuffer(), srcOffset, dstBuffer->GetBuffer(), dstOffset, size);
-    commandEncoder->endEncoding();
-    commandEncoder->release();
+
+    AddWork(size, 0);
+}
+
+void CommandQueue::EnqueueCopyBufferRect(Buffer *srcBuffer, const Origin &srcOrigin, size_t srcRowPitch,
+                                         size_t srcSlicePitch, Buffer *dstBuffer, const Origin &dstOrigin,
+                                         size_t dstRowPitch, size_t dstSlicePitch, const Size &region) {
+    std::lock_guard lock{mMutex};
+
+    EncodeCopyRect(srcBuffer->GetBuffer(), GetAliasKey(srcBuffer), GetOffset(srcOrigin, srcRowPitch, srcSlicePitch),
+                   srcRowPitch, srcSlicePitch, dstBuffer->GetBuffer(), GetAliasKey(dstBuffer),
+                   GetOffset(dstOrigin, dstRowPitch, dstSlicePitch), dstRowPitch, dstSlicePitch, region);
+
+    AddWork(GetVolume(region), 0);
+}
+
+void *CommandQueue::EnqueueMapBuffer(Buffer *buffer, cl_map_flags flags, size_t offset, size_t size, bool blocking) {
+    auto readBack = !Util::TestAnyFlagSet(flags, CL_MAP_WRITE_INVALIDATE_REGION);
+    auto hostPtr = static_cast<uint8_t *>(buffer->GetHostPtr());
+    Mapping mapping{flags, offset, size};
+
+    if (IsHostAccessible(buffer)) {
+        auto contents = static_cast<uint8_t *>(buffer->GetBuffer()->contents()) + offset;
+        auto data = hostPtr ? hostPtr + offset : contents;
+
+        // Even an invalidated region has to wait for earlier commands, as they may still read from it.
+        EnqueueHostCopy([=]() {
+            if (readBack && data != contents) {
+                memcpy(data, contents, size);
+            }
+        }, blocking);
+        buffer->AddMapping(data, mapping);
+
+        return data;
+    }
+
+    void *data;
+
+    // CL_MEM_USE_HOST_PTR buffers are mapped at the host pointer, others through pooled staging the GPU can copy to.
+    if (hostPtr) {
+        data = hostPtr + offset;
+
+        if (readBack) {
+            EnqueueReadBuffer(buffer, offset, data, size, false);
+        }
+    } else {
+        mapping.Staging = AllocateMapStaging(size, mapping.Allocation);
+        data = mapping.Staging->contents();
+
+        if (readBack) {
+            std::lock_guard lock{mMutex};
+            auto commandEncoder = GetBlitCommandEncoder();
+
+            commandEncoder->copyFromBuffer(buffer->GetBuffer(), offset, mapping.Staging, 0, size);
+
+            AddWork(size, 0);
+        }
+    }
+
+    buffer->AddMapping(data, mapping);
+
+    // Even an invalidated region has to wait for earlier commands, as they may still read from or write to it.
+    if (blocking) {
+        WaitPending();
+    }
+
+    return data;
+}
+
+void CommandQueue::EnqueueUnmapBuffer(Buffer *buffer, void *data, const Mapping &mapping) {
+    auto writeBack = Util::TestAnyFlagSet(mapping.Flags, CL_MAP_WRITE | CL_MAP_WRITE_INVALIDATE_REGION);
+
+    if (IsHostAccessible(buffer)) {
+        auto contents = static_cast<uint8_t *>(buffer->GetBuffer()->contents()) + mapping.Offset;
+
+        if (writeBack && data != contents) {
+            EnqueueHostCopy([=]() {
+                memcpy(contents, data, mapping.Length);
+            }, false);
+        }
+
+        return;
+    }
+
+    if (!mapping.Staging) {
+        if (writeBack) {
+            EnqueueWriteBuffer(data, buffer, mapping.Offset, mapping.Length, false);
+        }
+
+        return;
+    }
+
+    std::lock_guard lock{mMutex};
+
+    // Read only mappings are dropped without touching the buffer.
+    if (writeBack) {
+        auto commandEncoder = GetBlitCommandEncoder();
+
+        commandEncoder->copyFromBuffer(mapping.Staging, 0, buffer->GetBuffer(), mapping.Offset, mapping.Length);
+    }
+
+    ReleaseMapStaging(mapping);
+
+    if (writeBack) {
+        AddWork(mapping.Length, 0);
+    }
+}
+
+void *CommandQueue::EnqueueMapImage(Image *image, cl_map_flags flags, const Origin &origin, const Size &region,
+                                    size_t &rowPitch, size_t &slicePitch, bool blocking) {
+    auto slices = GetImageSlices(image, origin, region);
+
+    // The layers of a 1D image array are its rows, so they are packed one row apart.
+    rowPitch = region.w * Util::GetFormatSize(image->GetFormat());
+    slicePitch = image->GetType() == CL_MEM_OBJECT_IMAGE1D_ARRAY ? rowPitch : rowPitch * std::max(region.h, 1lu);
+
+    auto size = GetVolume(region) * Util::GetFormatSize(image->GetFormat());
+    Mapping mapping{flags, 0, size, origin, region, rowPitch, slicePitch};
+
+    // Textures aren't linear, so the region is always mapped through pooled staging in a packed layout.
+    mapping.Staging = AllocateMapStaging(size, mapping.Allocation);
+
+    if (!Util::TestAnyFlagSet(flags, CL_MAP_WRITE_INVALIDATE_REGION)) {
+        std::lock_guard lock{mMutex};
+        auto commandEncoder = GetBlitCommandEncoder();
+
+        for (size_t i = 0; i != slices.SliceCount; ++i) {
+            commandEncoder->copyFromTexture(image->GetTexture(), slices.FirstSlice + i, 0, slices.SliceOrigin,
+                                            slices.SliceSize, mapping.Staging, slicePitch * i, rowPitch, slicePitch);
+        }
+
+        AddWork(size, 0);
+    }
+
+    auto data = mapping.Staging->contents();
+
+    image->AddMapping(data, mapping);
+
+    // Even an invalidated region has to wait for earlier commands, as they may still read from or write to it.
+    if (blocking) {
+        WaitPending();
+    }
+
+    return data;
+}
+
+void CommandQueue::EnqueueUnmapImage(Image *image, const Mapping &mapping) {
+    auto writeBack = Util::TestAnyFlagSet(mapping.Flags, CL_MAP_WRITE | CL_MAP_WRITE_INVALIDATE_REGION);
+    std::lock_guard lock{mMutex};
+
+    // Only the mapped region is written back, and only if the mapping allowed writes.
+    if (writeBack) {
+        auto slices = GetImageSlices(image, mapping.ImageOrigin, mapping.ImageRegion);
+        auto commandEncoder = GetBlitCommandEncoder();
+
+        for (size_t i = 0; i != slices.SliceCount; ++i) {
+            commandEncoder->copyFromBuffer(mapping.Staging, mapping.SlicePitch * i, mapping.RowPitch,
+                                           mapping.SlicePitch, slices.SliceSize, image->GetTexture(),
+                                           slices.FirstSlice + i, 0, slices.SliceOrigin);
+        }
+    }
+
+    ReleaseMapStaging(mapping);
+
+    if (writeBack) {
+        AddWork(mapping.Length, 0);
+    }
 }
 
 void CommandQueue::EnqueueFillBuffer(const void *srcData, size_t srcSize, Buffer *dstBuffer, size_t dstOffset,
                                      size_t dstSize) {
-    auto commandEncoder = mCommandBuffer->blitCommandEncoder();
-    assert(commandEncoder);
+    std::lock_guard lock{mMutex};
+
+    // Metal fills bytes natively, but only on four byte aligned ranges.
+    if (IsUniformPattern(srcData, srcSize) && !(dstOffset % 4) && !(dstSize % 4)) {
+        auto commandEncoder = GetBlitCommandEncoder();
+
+        commandEncoder->fillBuffer(dstBuffer->GetBuffer(), NS::Range::Make(dstOffset, dstSize),
+                                   static_cast<const uint8_t *>(srcData)[0]);
+    } else {
+        // The period is the pattern rotated so that it starts at an aligned chunk, see FillBuffer in BuiltinLibrary.
+        std::array<uint8_t, 128> period{};
+        auto periodSize = std::max(srcSize, FillChunkSize);
+        assert(std::has_single_bit(srcSize) && periodSize <= period.size());
+
+        for (size_t i = 0; i != periodSize; ++i) {
+            period[i] = static_cast<const uint8_t *>(srcData)[(i + srcSize - dstOffset % srcSize) % srcSize];
+        }
 
-    auto srcBuffer = new Buffer(mContext, CL_MEM_WRITE_ONLY | CL_MEM_COPY_HOST_PTR, srcData, srcSize);
-    assert(srcBuffer);
+        FillArguments arguments{dstOffset, dstSize, static_cast<uint32_t>(periodSize)};
+        auto begin = dstOffset / FillChunkSize * FillChunkSize;
+        auto end = (dstOffset + dstSize + FillChunkSize - 1) / FillChunkSize * FillChunkSize;
+        auto pipelineState = mDevice->GetBuiltinLibrary()->GetFillBufferPipelineState();
+        auto commandEncoder = GetComputeCommandEncoder();
 
-    for (size_t i = 0; i < dstSize; i += srcSize) {
-        commandEncoder->copyFromBuffer(srcBuffer->GetBuffer(), 0, dstBuffer->GetBuffer(), dstOffset + i, srcSize);
+        std::array<const void *, 1> writes{GetAliasKey(dstBuffer)};
+
+        ResolveHazards(commandEncoder, {}, writes);
+        commandEncoder->setComputePipelineState(pipelineState);
+        commandEncoder->setBuffer(dstBuffer->GetBuffer(), 0, 0);
+        commandEncoder->setBytes(period.data(), periodSize, 1);
+        commandEncoder->setBytes(&arguments, sizeof(arguments), 2);
+        commandEncoder->dispatchThreads(MTL::Size::Make((end - begin) / FillChunkSize, 1, 1),
+                                        MTL::Size::Make(std::min<NS::UInteger>(
+                                            pipelineState->maxTotalThreadsPerThreadgroup(), 256), 1, 1));
     }
 
-    commandEncoder->endEncoding();
-    commandEncoder->release();
-    mCommandBuffer->addCompletedHandler([srcBuffer](MTL::CommandBuffer *commandBuffer) {
-        srcBuffer->Release();
-        delete srcBuffer;
-    });
+    AddWork(dstSize, 0);
+}
+
+void CommandQueue::EnqueueFillImage(const void *fillColor, Image *dstImage, const Origin &dstOrigin,
+                                    const Size &dstRegion) {
+    std::array<uint8_t, 16> pixel{};
+    auto format = dstImage->GetFormat();
+    auto pixelSize = Util::GetFormatSize(format);
+
+    Util::ConvertToPixel(format, fillColor, pixel.data());
+
+    auto slices = GetImageSlices(dstImage, dstOrigin, dstRegion);
+    auto rowPitch = slices.SliceSize.width * pixelSize;
+    auto slicePitch = rowPitch * slices.SliceSize.height;
+    auto depth = slices.SliceSize.depth * slices.SliceCount;
+    std::lock_guard lock{mMutex};
+
+    // One slice is filled on the host and copied into every slice or layer of the region.
+    auto srcAllocation = AllocateStaging(slicePitch);
+    auto commandEncoder = GetBlitCommandEncoder();
+
+    FillPattern(srcAllocation.Data, slicePitch, pixel.data(), pixelSize);
+
+    for (size_t i = 0; i != slices.SliceCount; ++i) {
+        for (size_t j = 0; j != slices.SliceSize.depth; ++j) {
+            auto origin = slices.SliceOrigin;
+
+            origin.z += j;
+            commandEncoder->copyFromBuffer(srcAllocation.Buffer, srcAllocation.Offset, rowPitch, slicePitch,
+                                           MTL::Size::Make(slices.SliceSize.width, slices.SliceSize.height, 1),
+                                           dstImage->GetTexture(), slices.FirstSlice + i, 0, origin);
+        }
+    }
+
+    AddWork(slicePitch * depth, 0);
 }
 
 void CommandQueue::EnqueueReadImage(Image *srcImage, const Origin &srcOrigin, const Size &srcRegion, void *dstData,
                                     size_t dstRowPitch, size_t dstSlicePitch) {
-    auto commandEncoder = mCommandBuffer->blitCommandEncoder();
-    assert(commandEncoder);
-
-    auto dstBuffer = new Buffer(mContext, CL_MEM_ALLOC_HOST_PTR, dstSlicePitch * srcRegion.d);
-    assert(dstBuffer);
+    auto dstSize = dstSlicePitch * srcRegion.d;
+    std::lock_guard lock{mMutex};
+    auto dstAllocation = AllocateStaging(dstSize);
+    auto commandEncoder = GetBlitCommandEncoder();
 
     commandEncoder->copyFromTexture(srcImage->GetTexture(), 0, 0, ConvertToOrigin(srcOrigin), ConvertToSize(srcRegion),
-                                    dstBuffer->GetBuffer(), 0, dstRowPitch, dstSlicePitch);
-    commandEncoder->endEncoding();
-    commandEncoder->release();
-    mCommandBuffer->addCompletedHandler([dstData, dstBuffer](MTL::CommandBuffer *commandBuffer) {
-        memcpy(dstData, dstBuffer->Map(), dstBuffer->GetSize());
-        dstBuffer->Unmap();
-        dstBuffer->Release();
-        delete dstBuffer;
+                                    dstAllocation.Buffer, dstAllocation.Offset, dstRowPitch, dstSlicePitch);
+    mCommandBuffer->addCompletedHandler([dstData, dstAllocation, dstSize](MTL::CommandBuffer *commandBuffer) {
+        memcpy(dstData, dstAllocation.Data, dstSize);
     });
+
+    AddWork(dstSize, 0);
 }
 
 void CommandQueue::EnqueueWriteImage(const void *srcData, size_t srcRowPitch, size_t srcSlicePitch,
                                      const Size &srcRegion, Image *dstImage, const Origin &dstOrigin) {
-    auto commandEncoder = mCommandBuffer->blitCommandEncoder();
-    assert(commandEncoder);
-
-    auto srcBuffer = new Buffer(mContext, CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR, srcData,
-                                srcSlicePitch * srcRegion.d);
-    assert(srcBuffer);
-
-    commandEncoder->copyFromBuffer(srcBuffer->GetBuffer(), 0, srcRowPitch, srcSlicePitch, ConvertToSize(srcRegion),
-                                   dstImage->GetTexture(), 0, 0, ConvertToOrigin(dstOrigin));
-    commandEncoder->endEncoding();
-    commandEncoder->release();
-    mCommandBuffer->addCompletedHandler([srcBuffer](MTL::CommandBuffer *commandBuffer) {
-        srcBuffer->Release();
-        delete srcBuffer;
-    });
+    auto srcSize = srcSlicePitch * srcRegion.d;
+    std::lock_guard lock{mMutex};
+    auto srcAllocation = AllocateStaging(srcSize);
+    auto commandEncoder = GetBlitCommandEncoder();
+
+    memcpy(srcAllocation.Data, srcData, srcSize);
+    commandEncoder->copyFromBuffer(srcAllocation.Buffer, srcAllocation.Offset, srcRowPitch, srcSlicePitch,
+                                   ConvertToSize(srcRegion), dstImage->GetTexture(), 0, 0, ConvertToOrigin(dstOrigin));
+
+    AddWork(srcSize, 0);
 }
 
 void CommandQueue::EnqueueCopyImage(Image *srcImage, const Origin &srcOrigin, const Size &srcRegion, Image *dstImage,
                                     const Origin &dstOrigin) {
-    auto commandEncoder = mCommandBuffer->blitCommandEncoder();
-    assert(commandEncoder);
+    std::lock_guard lock{mMutex};
+    auto commandEncoder = GetBlitCommandEncoder();
 
     commandEncoder->copyFromTexture(srcImage->GetTexture(), 0, 0, ConvertToOrigin(srcOrigin), ConvertToSize(srcRegion),
                                     dstImage->GetTexture(), 0, 0, ConvertToOrigin(dstOrigin));
-    commandEncoder->endEncoding();
-    commandEncoder->release();
+
+    AddWork(GetVolume(srcRegion) * Util::GetFormatSize(srcImage->GetFormat()), 0);
 }
 
 void CommandQueue::EnqueueCopyImageToBuffer(Image *srcImage, const Origin &srcOrigin, const Size &srcRegion,
                                             Buffer *dstBuffer, size_t dstOffset) {
-    auto commandEncoder = mCommandBuffer->blitCommandEncoder();
-    assert(commandEncoder);
+    std::lock_guard lock{mMutex};
+    auto commandEncoder = GetBlitCommandEncoder();
 
     auto dstRowPitch = srcRegion.w * cml::Util::GetFormatSize(srcImage->GetFormat());
     assert(!(dstRowPitch % 32) || !(dstRowPitch % 767));
@@ -202,14 +709,14 @@ void CommandQueue::EnqueueCopyImageToBuffer(Image *srcImage, const Origin &srcOr
 
     commandEncoder->copyFromTexture(srcImage->GetTexture(), 0, 0, ConvertToOrigin(srcOrigin), ConvertToSize(srcRegion),
                                     dstBuffer->GetBuffer(), dstOffset, dstRowPitch, dstSlicePitch);
-    commandEncoder->endEncoding();
-    commandEncoder->release();
+
+    AddWork(dstSlicePitch * std::max(srcRegion.d, 1lu), 0);
 }
 
 void CommandQueue::EnqueueCopyBufferToImage(Buffer *srcBuffer, size_t srcOffset, const Size &srcRegion, Image *dstImage,
                                             const Origin &dstOrigin) {
-    auto commandEncoder = mCommandBuffer->blitCommandEncoder();
-    assert(commandEncoder);
+    std::lock_guard lock{mMutex};
+    auto commandEncoder = GetBlitCommandEncoder();
 
     auto srcRowPitch = srcRegion.w * cml::Util::GetFormatSize(dstImage->GetFormat());
     assert(!(srcRowPitch % 32) || !(srcRowPitch % 767));
@@ -219,65 +726,119 @@ void CommandQueue::EnqueueCopyBufferToImage(Buffer *srcBuffer, size_t srcOffset,
 
     commandEncoder->copyFromBuffer(srcBuffer->GetBuffer(), srcOffset, srcRowPitch, srcSlicePitch,
                                    ConvertToSize(srcRegion), dstImage->GetTexture(), 0, 0, ConvertToOrigin(dstOrigin));
-    commandEncoder->endEncoding();
-    commandEncoder->release();
+
+    AddWork(srcSlicePitch * std::max(srcRegion.d, 1lu), 0);
 }
 
 void CommandQueue::EnqueueDispatch(Kernel *kernel, const Size &globalWorkSize) {
-    auto commandEncoder = mCommandBuffer->computeCommandEncoder();
-    assert(commandEncoder);
-
-    Size workGroupSize{kernel->GetWorkItemExecutionWidth(),
-                       kernel->GetWorkGroupSize() / kernel->GetWorkItemExecutionWidth(), 1};
+    auto workGroupSize = kernel->GetDefaultWorkGroupSize();
     assert(workGroupSize.w && workGroupSize.h && workGroupSize.d);
 
-    BindResources(commandEncoder, kernel);
-    commandEncoder->setComputePipelineState(kernel->GetPipelineState(workGroupSize));
-    commandEncoder->dispatchThreads(ConvertToSize(globalWorkSize), ConvertToSize(workGroupSize));
-    commandEncoder->endEncoding();
-    commandEncoder->release();
+    EnqueueDispatch(kernel->GetPipelineState(workGroupSize), kernel->GetArgTable(), globalWorkSize, workGroupSize);
 }
 
 void CommandQueue::EnqueueDispatch(Kernel *kernel, const Size &globalWorkSize, const Size &localWorkSize) {
-    auto commandEncoder = mCommandBuffer->computeCommandEncoder();
-    assert(commandEncoder);
+    EnqueueDispatch(kernel->GetPipelineState(localWorkSize), kernel->GetArgTable(), globalWorkSize, localWorkSize);
+}
+
+void CommandQueue::EnqueueDispatch(MTL::ComputePipelineState *pipelineState,
+                                   const std::unordered_map<uint32_t, Arg> &argTable, const Size &globalWorkSize,
+                                   const Size &workGroupSize) {
+    std::lock_guard lock{mMutex};
+
+    // The resource lists are reused across dispatches, so they only allocate until they reach their peak size.
+    mReads.clear();
+    mWrites.clear();
+    CollectResources(argTable, mReads, mWrites);
+
+    auto commandEncoder = GetComputeCommandEncoder();
+
+    ResolveHazards(commandEncoder, mReads, mWrites);
+    BindResources(commandEncoder, argTable);
+    commandEncoder->setComputePipelineState(pipelineState);
+    commandEncoder->dispatchThreads(ConvertToSize(globalWorkSize), ConvertToSize(workGroupSize));
 
-    BindResources(commandEncoder, kernel);
-    commandEncoder->setComputePipelineState(kernel->GetPipelineState(localWorkSize));
-    commandEncoder->dispatchThreads(ConvertToSize(globalWorkSize), ConvertToSize(localWorkSize));
-    commandEncoder->endEncoding();
-    commandEncoder->release();
+    AddWork(0, GetVolume(globalWorkSize));
 }
 
 void CommandQueue::EnqueueSignalEvent(Event *event) {
-    mCommandBuffer->encodeSignalEvent(event->GetEvent(), 1);
-    mCommandBuffer->addScheduledHandler([event](MTL::CommandBuffer *commandBuffer) {
-        event->SetStatus(CL_QUEUED);
-        event->SetStatus(CL_RUNNING);
-    });
-    mCommandBuffer->addCompletedHandler([event](MTL::CommandBuffer *commandBuffer) {
-        event->SetStatus(CL_COMPLETE);
-    });
+    std::lock_guard lock{mMutex};
+
+    // The timeline is signaled once per command buffer on commit, so events don't break the current encoder.
+    event->Retain();
+    event->SetValue(mSerial + 1);
+    mEvents.push_back(event);
+
+    // GPU timestamps are only available per command buffer, so each profiled command gets its own.
+    if (IsProfiling()) {
+        event->SetProfilingInfo({Util::GetHostTime()});
+        Commit(false);
+    }
 }
 
 void CommandQueue::EnqueueWaitEvent(Event *event) {
-    mCommandBuffer->encodeWait(event->GetEvent(), 1);
+    auto commandQueue = event->GetCommandQueue();
+
+    // Flush the signaling queue before taking the lock, so two queues waiting on each other can't deadlock.
+    if (commandQueue != this) {
+        event->Flush();
+    }
+
+    std::lock_guard lock{mMutex};
+
+    if (commandQueue != this) {
+        EndEncoding();
+        mCommandBuffer->encodeWait(event->GetTimeline(), event->GetValue());
+        mWaitCount++;
+    } else if (IsOutOfOrder() && event->GetValue() > mSerial) {
+        // The timeline is signaled at the end of the current command buffer, so an encoder boundary orders the work.
+        EndEncoding();
+    }
+}
+
+void CommandQueue::EnqueueBarrier() {
+    std::lock_guard lock{mMutex};
+
+    EndEncoding();
 }
 
 void CommandQueue::Flush() {
-    mCommandBuffer->commit();
-    mCommittedCommandBuffer.push_back(mCommandBuffer);
+    std::lock_guard lock{mMutex};
 
-    InitCommandBuffer();
+    Commit(false);
+}
+
+void CommandQueue::Flush(uint64_t serial) {
+    std::lock_guard lock{mMutex};
+
+    // The command buffer holding the serial may already be submitted, either explicitly or by the flush policy.
+    if (mSerial < serial) {
+        Commit(false);
+    }
 }
 
 void CommandQueue::WaitIdle() {
-    for (auto commandBuffer: mCommittedCommandBuffer) {
+    std::deque<MTL::CommandBuffer *> commandBuffers;
+    MTL::CommandBuffer *lastCommandBuffer;
+
+    {
+        std::lock_guard lock{mMutex};
+
+        commandBuffers = mCommittedCommandBuffers.Take();
+        lastCommandBuffer = mLastCommandBuffer ? mLastCommandBuffer->retain() : nullptr;
+    }
+
+    // Wait without the lock so other threads keep encoding. Another thread may already have taken the older command
+    // buffers, but the queue executes them in order, so waiting on the last one also covers those.
+    for (auto commandBuffer: commandBuffers) {
         commandBuffer->waitUntilCompleted();
         commandBuffer->release();
     }
 
-    mCommittedCommandBuffer.clear();
+    if (lastCommandBuffer) {
+        lastCommandBuffer->waitUntilCompleted();
+        lastCommandBuffer->release();
+    }
 }
 
 Context *CommandQueue::GetContext() const {
@@ -292,14 +853,405 @@ cl_command_queue_properties CommandQueue::GetProperties() const {
     return mProperties;
 }
 
+bool CommandQueue::IsOutOfOrder() const {
+    return Util::TestAnyFlagSet(mProperties, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE);
+}
+
+bool CommandQueue::IsProfiling() const {
+    return Util::TestAnyFlagSet(mProperties, CL_QUEUE_PROFILING_ENABLE);
+}
+
+bool CommandQueue::IsHostAccessible(Buffer *buffer) const {
+    return mUnifiedMemory && buffer->GetBuffer()->storageMode() != MTL::StorageModePrivate;
+}
+
+MTL::SharedEvent *CommandQueue::GetTimeline() const {
+    return mTimeline;
+}
+
+uint64_t CommandQueue::GetEncoderCount() const {
+    return mEncoder.GetCount();
+}
+
+uint64_t CommandQueue::GetCommandCount() const {
+    return mCommandCount;
+}
+
+void CommandQueue::SetFlushPolicy(const FlushPolicy &flushPolicy) {
+    mFlushPolicy = flushPolicy;
+}
+
+FlushPolicy CommandQueue::GetFlushPolicy() const {
+    return mFlushPolicy;
+}
+
+QueueStatistics CommandQueue::GetStatistics() const {
+    std::lock_guard lock{mStatisticsMutex};
+
+    return mStatistics;
+}
+
+uint64_t CommandQueue::GetInFlightCount() const {
+    return mInFlightCount;
+}
+
 void CommandQueue::InitCommandQueue() {
     mCommandQueue = mDevice->GetDevice()->newCommandQueue();
     assert(mCommandQueue);
 }
 
+void CommandQueue::InitTimeline() {
+    mTimeline = mDevice->GetDevice()->newSharedEvent();
+    assert(mTimeline);
+
+    mHostTimeline = mDevice->GetDevice()->newSharedEvent();
+    assert(mHostTimeline);
+}
+
 void CommandQueue::InitCommandBuffer() {
     mCommandBuffer = mCommandQueue->commandBuffer();
     assert(mCommandBuffer);
+
+    mEncoder.ResetCount();
+    mCommandCount = 0;
+    mWaitCount = 0;
+    mByteCount = 0;
+    mWorkCount = 0;
+}
+
+MTL::BlitCommandEncoder *CommandQueue::GetBlitCommandEncoder() {
+    mEncoder.Begin(mCommandBuffer, EncoderType::Blit);
+
+    if (!mCommandCount++) {
+        mFirstCommandTime = std::chrono::steady_clock::now();
+        mEpoch = mDevice->GetBufferAllocator()->OpenEpoch();
+    }
+
+    return static_cast<MTL::BlitCommandEncoder *>(mEncoder.GetEncoder());
+}
+
+MTL::ComputeCommandEncoder *CommandQueue::GetComputeCommandEncoder() {
+    if (mEncoder.Begin(mCommandBuffer, EncoderType::Compute)) {
+        mHazardTracker.Reset();
+    }
+
+    if (!mCommandCount++) {
+        mFirstCommandTime = std::chrono::steady_clock::now();
+        mEpoch = mDevice->GetBufferAllocator()->OpenEpoch();
+    }
+
+    return static_cast<MTL::ComputeCommandEncoder *>(mEncoder.GetEncoder());
+}
+
+void CommandQueue::EndEncoding() {
+    mEncoder.End();
+}
+
+StagingAllocation CommandQueue::AllocateStaging(size_t size) {
+    StagingAllocation allocation{};
+
+    mStagingRing.Reclaim(mCompletedSerial);
+
+    // Large transfers get a dedicated buffer, so they don't starve the ring for the small ones.
+    if (size <= mStagingRing.GetCapacity() / 4 && mStagingRing.Allocate(size, mSerial + 1, allocation)) {
+        return allocation;
+    }
+
+    auto buffer = mDevice->GetDevice()->newBuffer(std::max(size, size_t{1}), MTL::ResourceStorageModeShared);
+    assert(buffer);
+
+    mStagingBuffers.push_back(buffer);
+
+    return {buffer, 0, static_cast<uint8_t *>(buffer->contents())};
+}
+
+MTL::Buffer *CommandQueue::AllocateMapStaging(size_t size, BufferAllocation &allocation) {
+    // Mappings outlive command buffers, so they are suballocated from the buffer heaps rather than the staging ring.
+    allocation = mDevice->GetBufferAllocator()->Allocate(MapStagingOptions, std::max(size, size_t{1}));
+
+    auto buffer = allocation.Heap->newBuffer(std::max(size, size_t{1}), MapStagingOptions, allocation.Offset);
+    assert(buffer);
+
+    return buffer;
+}
+
+void CommandQueue::ReleaseMapStaging(const Mapping &mapping) {
+    // The allocator defers the free until the command buffers encoded so far complete.
+    mapping.Staging->release();
+    mDevice->GetBufferAllocator()->Free(mapping.Allocation);
+}
+
+void CommandQueue::ResolveHazards(MTL::ComputeCommandEncoder *commandEncoder, std::span<const void *const> reads,
+                                  std::span<const void *const> writes) {
+    // Dispatches in a concurrent encoder may overlap. An in-order queue separates every dispatch, while an
+    // out-of-order queue only separates dispatches whose resources conflict.
+    auto barrier = IsOutOfOrder() ? mHazardTracker.HasHazard(reads, writes) : !mHazardTracker.IsEmpty();
+
+    if (barrier) {
+        commandEncoder->memoryBarrier(MTL::BarrierScopeBuffers | MTL::BarrierScopeTextures);
+        mHazardTracker.Reset();
+    }
+
+    mHazardTracker.Add(reads, writes);
+}
+
+void CommandQueue::EncodeCopyRect(MTL::Buffer *srcBuffer, const void *srcKey, size_t srcOffset, size_t srcRowPitch,
+                                  size_t srcSlicePitch, MTL::Buffer *dstBuffer, const void *dstKey, size_t dstOffset,
+                                  size_t dstRowPitch, size_t dstSlicePitch, const Size &region) {
+    auto spanSize = GetSpanSize(region, srcRowPitch, srcSlicePitch, dstRowPitch, dstSlicePitch);
+
+    // Every blit has a fixed cost, so many short spans are copied by a single dispatch instead.
+    if (spanSize < MaxComputeCopySpanSize && spanSize < GetVolume(region)) {
+        CopyRectArguments arguments{srcOffset, srcRowPitch, srcSlicePitch, dstOffset, dstRowPitch, dstSlicePitch};
+        auto pipelineState = mDevice->GetBuiltinLibrary()->GetCopyBufferRectPipelineState();
+        auto threadCount = std::min<NS::UInteger>(pipelineState->maxTotalThreadsPerThreadgroup(), 256);
+        auto width = std::min<NS::UInteger>(region.w, threadCount);
+        std::array<const void *, 1> reads{srcKey};
+        std::array<const void *, 1> writes{dstKey};
+        auto commandEncoder = GetComputeCommandEncoder();
+
+        ResolveHazards(commandEncoder, reads, writes);
+        commandEncoder->setComputePipelineState(pipelineState);
+        commandEncoder->setBuffer(srcBuffer, 0, 0);
+        commandEncoder->setBuffer(dstBuffer, 0, 1);
+        commandEncoder->setBytes(&arguments, sizeof(arguments), 2);
+        commandEncoder->dispatchThreads(ConvertToSize(region),
+                                        MTL::Size::Make(width, std::min<NS::UInteger>(region.h, threadCount / width),
+                                                        1));
+    } else {
+        auto commandEncoder = GetBlitCommandEncoder();
+
+        ForEachSpan(region, spanSize, srcRowPitch, srcSlicePitch, dstRowPitch, dstSlicePitch,
+                    [&](size_t srcSpanOffset, size_t dstSpanOffset) {
+                        commandEncoder->copyFromBuffer(srcBuffer, srcOffset + srcSpanOffset, dstBuffer,
+                                                       dstOffset + dstSpanOffset, spanSize);
+                    });
+    }
+}
+
+bool CommandQueue::IsIdle() const {
+    return !mCommandCount && !mWaitCount && !mInFlightCount;
+}
+
+void CommandQueue::EnqueueHostCopy(std::function<void()> copy, bool blocking) {
+    MTL::CommandBuffer *commandBuffer;
+    uint64_t value;
+
+    {
+        std::lock_guard lock{mMutex};
+
+        if (IsIdle()) {
+            copy();
+            return;
+        }
+
+        // The copy runs once the earlier commands complete, and later commands wait for it on the host timeline.
+        value = ++mHostSerial;
+
+        if (!blocking) {
+            // The handler holds its own reference, so it never depends on the queue being alive.
+            mCommandBuffer->addCompletedHandler([hostTimeline = mHostTimeline->retain(), copy = std::move(copy),
+                                                 value](MTL::CommandBuffer *) {
+                copy();
+                hostTimeline->setSignaledValue(value);
+                hostTimeline->release();
+            });
+        }
+
+        Commit(false);
+        mCommandBuffer->encodeWait(mHostTimeline, value);
+        mWaitCount++;
+
+        if (!blocking) {
+            return;
+        }
+
+        commandBuffer = mLastCommandBuffer->retain();
+    }
+
+    // Wait without the lock, so other threads keep encoding and completion handlers can enqueue to this queue.
+    commandBuffer->waitUntilCompleted();
+    commandBuffer->release();
+
+    copy();
+    mHostTimeline->setSignaledValue(value);
+}
+
+void CommandQueue::WaitPending() {
+    uint64_t serial;
+
+    {
+        std::lock_guard lock{mMutex};
+
+        // Commands that are still being encoded complete with the next serial.
+        serial = mCommandCount || mWaitCount ? mSerial + 1 : mSerial;
+
+        if (serial > mSerial) {
+            Commit(false);
+        }
+    }
+
+    std::unique_lock lock{mInFlightMutex};
+
+    mInFlightCondition.wait(lock, [this, serial]() {
+        return mCompletedSerial >= serial;
+    });
+}
+
+void CommandQueue::AddWork(uint64_t byteCount, uint64_t workCount) {
+    mByteCount += byteCount;
+    mWorkCount += workCount;
+
+    auto &policy = mFlushPolicy;
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                         mFirstCommandTime).count();
+
+    // Submit early when the GPU has run dry, otherwise batch until one of the thresholds is crossed.
+    if ((policy.CommandCount && mCommandCount >= policy.CommandCount) ||
+        (policy.ByteCount && mByteCount >= policy.ByteCount) ||
+        (policy.WorkCount && mWorkCount >= policy.WorkCount) ||
+        (policy.Interval && elapsed >= policy.Interval) ||
+        (policy.IdleCommandCount && mCommandCount >= policy.IdleCommandCount && !mInFlightCount)) {
+        Commit(true);
+    }
+}
+
+void CommandQueue::Commit(bool automatic) {
+    EndEncoding();
+
+    {
+        std::lock_guard lock{mStatisticsMutex};
+        auto now = GetSeconds(std::chrono::steady_clock::now());
+
+        if (!mStatistics.SubmitCount) {
+            mStatistics.FirstSubmitTime = now;
+        }
+
+        mStatistics.LastSubmitTime = now;
+        mStatistics.SubmitCount++;
+        mStatistics.AutoSubmitCount += automatic;
+    }
+
+    auto inFlightCount = ++mInFlightCount;
+
+    {
+        std::lock_guard lock{mStatisticsMutex};
+
+        mStatistics.MaxInFlightCount = std::max(mStatistics.MaxInFlightCount, inFlightCount);
+    }
+
+    auto serial = mSerial + 1;
+    auto epoch = mCommandCount ? mEpoch : 0;
+    auto submitTime = IsProfiling() ? Util::GetHostTime() : 0;
+
+    mCommandBuffer->encodeSignalEvent(mTimeline, serial);
+    mCommandBuffer->addScheduledHandler([events = mEvents](MTL::CommandBuffer *commandBuffer) {
+        for (auto event: events) {
+            event->SetStatus(CL_SUBMITTED);
+            event->SetStatus(CL_RUNNING);
+        }
+    });
+    mCommandBuffer->addCompletedHandler([this, events = std::move(mEvents), stagingBuffers = std::move(mStagingBuffers),
+                                         serial, epoch, submitTime](MTL::CommandBuffer *commandBuffer) {
+        UpdateStatistics(commandBuffer);
+
+        for (auto event: events) {
+            if (submitTime) {
+                auto profilingInfo = event->GetProfilingInfo();
+
+                profilingInfo.Submit = submitTime;
+                profilingInfo.Start = static_cast<cl_ulong>(commandBuffer->GPUStartTime() * 1e9);
+                profilingInfo.End = static_cast<cl_ulong>(commandBuffer->GPUEndTime() * 1e9);
+                profilingInfo.Complete = Util::GetHostTime();
+                event->SetProfilingInfo(profilingInfo);
+            }
+
+            event->SetStatus(CL_COMPLETE);
+
+            if (!event->Release()) {
+                delete event;
+            }
+        }
+
+        for (auto stagingBuffer: stagingBuffers) {
+            stagingBuffer->release();
+        }
+
+        if (epoch) {
+            mDevice->GetBufferAllocator()->CloseEpoch(epoch);
+        }
+
+        // Handlers run in the order they were added, so every read back from the staging ring is done by now. The
+        // queue can be destroyed as soon as the count drops, so nothing may touch it after the lock is released.
+        std::lock_guard lock{mInFlightMutex};
+
+        mCompletedSerial = serial;
+        mInFlightCount--;
+        mInFlightCondition.notify_all();
+    });
+    mEvents.clear();
+    mStagingBuffers.clear();
+    mCommandBuffer->commit();
+    mCommittedCommandBuffers.Push(mCommandBuffer);
+    mSerial = serial;
+
+    if (mLastCommandBuffer) {
+        mLastCommandBuffer->release();
+    }
+
+    mLastCommandBuffer = mCommandBuffer->retain();
+
+    InitCommandBuffer();
+    RetireCommandBuffers();
+}
+
+void CommandQueue::RetireCommandBuffers() {
+    auto retireCount = mCommittedCommandBuffers.Retire();
+    std::lock_guard lock{mStatisticsMutex};
+
+    mStatistics.RetireCount += retireCount;
+}
+
+void CommandQueue::UpdateStatistics(MTL::CommandBuffer *commandBuffer) {
+    std::lock_guard lock{mStatisticsMutex};
+    auto startTime = commandBuffer->GPUStartTime();
+    auto endTime = commandBuffer->GPUEndTime();
+
+    if (mStatistics.LastGpuEndTime > 0.0 && startTime > mStatistics.LastGpuEndTime) {
+        auto gap = startTime - mStatistics.LastGpuEndTime;
+
+        mStatistics.GpuIdleTime += gap;
+        mStatistics.MaxGpuIdleGap = std::max(mStatistics.MaxGpuIdleGap, gap);
+    }
+
+    mStatistics.GpuBusyTime += endTime - startTime;
+    mStatistics.LastGpuEndTime = std::max(mStatistics.LastGpuEndTime, endTime);
+}
+
+void CommandQueue::PrintStatistics() const {
+    auto statistics = GetStatistics();
+    auto duration = statistics.LastSubmitTime - statistics.FirstSubmitTime;
+
+    std::fprintf(stderr, "clmtl: queue %p submitted %llu command buffers (%llu automatic, %.1f per second), "
+                         "GPU busy %.3f ms, idle %.3f ms, longest idle gap %.3f ms, %llu retired early, "
+                         "at most %llu in flight\n", this,
+                 static_cast<unsigned long long>(statistics.SubmitCount),
+                 static_cast<unsigned long long>(statistics.AutoSubmitCount),
+                 duration > 0.0 ? statistics.SubmitCount / duration : 0.0, statistics.GpuBusyTime * 1e3,
+                 statistics.GpuIdleTime * 1e3, statistics.MaxGpuIdleGap * 1e3,
+                 static_cast<unsigned long long>(statistics.RetireCount),
+                 static_cast<unsigned long long>(statistics.MaxInFlightCount));
+
+    auto allocatorStatistics = mDevice->GetBufferAllocator()->GetStatistics();
+
+    std::fprintf(stderr, "clmtl: buffer allocator has %llu heaps (%llu dedicated), %llu of %llu bytes used, "
+                         "largest free block %llu bytes, %llu frees pending\n",
+                 static_cast<unsigned long long>(allocatorStatistics.HeapCount),
+                 static_cast<unsigned long long>(allocatorStatistics.DedicatedHeapCount),
+                 static_cast<unsigned long long>(allocatorStatistics.UsedSize),
+                 static_cast<unsigned long long>(allocatorStatistics.ReservedSize),
+                 static_cast<unsigned long long>(allocatorStatistics.LargestFreeSize),
+                 static_cast<unsigned long long>(allocatorStatistics.PendingFreeCount));
 }
 
 } //namespace cml
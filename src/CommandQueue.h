@@ -19,12 +19,25 @@
 
 #include <array>
 #include <vector>
+#include <span>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
 #include <CL/cl_icd.h>
 
 #include "Metal.hpp"
 #include "Origin.h"
 #include "Size.h"
 #include "Object.h"
+#include "HazardTracker.h"
+#include "EncoderCoalescer.h"
+#include "CommandBufferRetirer.h"
+#include "StagingRing.h"
+#include "BufferAllocator.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,6 +59,44 @@ class Buffer;
 class Image;
 class Kernel;
 class Event;
+struct Arg;
+struct Mapping;
+
+struct MetalEncoderTraits {
+    using CommandBuffer = MTL::CommandBuffer;
+    using Encoder = MTL::CommandEncoder;
+
+    static Encoder *Begin(CommandBuffer *commandBuffer, EncoderType type);
+    static void End(Encoder *encoder);
+};
+
+struct MetalRetireTraits {
+    using CommandBuffer = MTL::CommandBuffer;
+
+    static bool IsCompleted(CommandBuffer *commandBuffer);
+    static void Release(CommandBuffer *commandBuffer);
+};
+
+struct FlushPolicy {
+    uint64_t CommandCount;
+    uint64_t ByteCount;
+    uint64_t WorkCount;
+    uint64_t Interval;
+    uint64_t IdleCommandCount;
+};
+
+struct QueueStatistics {
+    uint64_t SubmitCount;
+    uint64_t AutoSubmitCount;
+    double FirstSubmitTime;
+    double LastSubmitTime;
+    double GpuBusyTime;
+    double GpuIdleTime;
+    double MaxGpuIdleGap;
+    double LastGpuEndTime;
+    uint64_t RetireCount;
+    uint64_t MaxInFlightCount;
+};
 
 class CommandQueue : public _cl_command_queue, public Object {
 public:
@@ -54,10 +105,25 @@ public:
 public:
     CommandQueue(Context *context, Device *device, cl_command_queue_properties properties);
     ~CommandQueue() override;
-    void EnqueueReadBuffer(Buffer *srcBuffer, size_t srcOffset, void *dstData, size_t dstSize);
-    void EnqueueWriteBuffer(const void *srcData, Buffer *dstBuffer, size_t offset, size_t size);
+    void EnqueueReadBuffer(Buffer *srcBuffer, size_t srcOffset, void *dstData, size_t dstSize, bool blocking);
+    void EnqueueWriteBuffer(const void *srcData, Buffer *dstBuffer, size_t offset, size_t size, bool blocking);
+    void EnqueueReadBufferRect(Buffer *srcBuffer, const Origin &srcOrigin, size_t srcRowPitch, size_t srcSlicePitch,
+                               void *dstData, const Origin &dstOrigin, size_t dstRowPitch, size_t dstSlicePitch,
+                               const Size &region, bool blocking);
+    void EnqueueWriteBufferRect(const void *srcData, const Origin &srcOrigin, size_t srcRowPitch,
+                                size_t srcSlicePitch, Buffer *dstBuffer, const Origin &dstOrigin, size_t dstRowPitch,
+                                size_t dstSlicePitch, const Size &region, bool blocking);
     void EnqueueCopyBuffer(Buffer *srcBuffer, size_t srcOffset, Buffer *dstBuffer, size_t dstOffset, size_t size);
+    void EnqueueCopyBufferRect(Buffer *srcBuffer, const Origin &srcOrigin, size_t srcRowPitch, size_t srcSlicePitch,
+                               Buffer *dstBuffer, const Origin &dstOrigin, size_t dstRowPitch, size_t dstSlicePitch,
+                               const Size &region);
+    void *EnqueueMapBuffer(Buffer *buffer, cl_map_flags flags, size_t offset, size_t size, bool blocking);
+    void EnqueueUnmapBuffer(Buffer *buffer, void *data, const Mapping &mapping);
+    void *EnqueueMapImage(Image *image, cl_map_flags flags, const Origin &origin, const Size &region,
+                          size_t &rowPitch, size_t &slicePitch, bool blocking);
+    void EnqueueUnmapImage(Image *image, const Mapping &mapping);
     void EnqueueFillBuffer(const void *srcData, size_t srcSize, Buffer *dstBuffer, size_t dstOffset, size_t dstSize);
+    void EnqueueFillImage(const void *fillColor, Image *dstImage, const Origin &dstOrigin, const Size &dstRegion);
     void EnqueueReadImage(Image *srcImage, const Origin &srcOrigin, const Size &srcRegion, void *dstData,
                           size_t dstRowPitch, size_t dstSlicePitch);
     void EnqueueWriteImage(const void *srcData, size_t srcRowPitch, size_t srcSlicePitch, const Size &srcRegion,
@@ -70,24 +136,85 @@ public:
                                   const Origin &dstOrigin);
     void EnqueueDispatch(Kernel *kernel, const Size &globalWorkSize);
     void EnqueueDispatch(Kernel *kernel, const Size &globalWorkSize, const Size &localWorkSize);
+    void EnqueueDispatch(MTL::ComputePipelineState *pipelineState, const std::unordered_map<uint32_t, Arg> &argTable,
+                         const Size &globalWorkSize, const Size &workGroupSize);
     void EnqueueSignalEvent(Event *event);
     void EnqueueWaitEvent(Event *event);
+    void EnqueueBarrier();
     void Flush();
+    void Flush(uint64_t serial);
     void WaitIdle();
     Context *GetContext() const;
     Device *GetDevice() const;
     cl_command_queue_properties GetProperties() const;
+    bool IsOutOfOrder() const;
+    bool IsProfiling() const;
+    bool IsHostAccessible(Buffer *buffer) const;
+    MTL::SharedEvent *GetTimeline() const;
+    uint64_t GetEncoderCount() const;
+    uint64_t GetCommandCount() const;
+    void SetFlushPolicy(const FlushPolicy &flushPolicy);
+    FlushPolicy GetFlushPolicy() const;
+    QueueStatistics GetStatistics() const;
+    uint64_t GetInFlightCount() const;
 
 private:
     Context *mContext;
     Device *mDevice;
+    StagingRing mStagingRing;
+    bool mUnifiedMemory;
     cl_command_queue_properties mProperties;
     MTL::CommandQueue *mCommandQueue;
+    MTL::SharedEvent *mTimeline;
     MTL::CommandBuffer *mCommandBuffer;
-    std::vector<MTL::CommandBuffer *> mCommittedCommandBuffer;
+    EncoderCoalescer<MetalEncoderTraits> mEncoder;
+    uint64_t mSerial;
+    std::vector<Event *> mEvents;
+    std::vector<MTL::Buffer *> mStagingBuffers;
+    std::atomic<uint64_t> mCompletedSerial;
+    MTL::SharedEvent *mHostTimeline;
+    uint64_t mHostSerial;
+    uint64_t mWaitCount;
+    HazardTracker mHazardTracker;
+    std::vector<const void *> mReads;
+    std::vector<const void *> mWrites;
+    uint64_t mCommandCount;
+    uint64_t mByteCount;
+    uint64_t mWorkCount;
+    std::chrono::steady_clock::time_point mFirstCommandTime;
+    uint64_t mEpoch;
+    FlushPolicy mFlushPolicy;
+    std::atomic<uint64_t> mInFlightCount;
+    std::mutex mInFlightMutex;
+    std::condition_variable mInFlightCondition;
+    QueueStatistics mStatistics;
+    mutable std::mutex mStatisticsMutex;
+    CommandBufferRetirer<MetalRetireTraits> mCommittedCommandBuffers;
+    MTL::CommandBuffer *mLastCommandBuffer;
+    std::mutex mMutex;
 
     void InitCommandQueue();
+    void InitTimeline();
     void InitCommandBuffer();
+    MTL::BlitCommandEncoder *GetBlitCommandEncoder();
+    MTL::ComputeCommandEncoder *GetComputeCommandEncoder();
+    void EndEncoding();
+    StagingAllocation AllocateStaging(size_t size);
+    MTL::Buffer *AllocateMapStaging(size_t size, BufferAllocation &allocation);
+    void ReleaseMapStaging(const Mapping &mapping);
+    void ResolveHazards(MTL::ComputeCommandEncoder *commandEncoder, std::span<const void *const> reads,
+                        std::span<const void *const> writes);
+    void EncodeCopyRect(MTL::Buffer *srcBuffer, const void *srcKey, size_t srcOffset, size_t srcRowPitch,
+                        size_t srcSlicePitch, MTL::Buffer *dstBuffer, const void *dstKey, size_t dstOffset,
+                        size_t dstRowPitch, size_t dstSlicePitch, const Size &region);
+    bool IsIdle() const;
+    void EnqueueHostCopy(std::function<void()> copy, bool blocking);
+    void WaitPending();
+    void AddWork(uint64_t byteCount, uint64_t workCount);
+    void Commit(bool automatic);
+    void RetireCommandBuffers();
+    void UpdateStatistics(MTL::CommandBuffer *commandBuffer);
+    void PrintStatistics() const;
 };
 
 } //namespace cml
@@ -16,12 +16,26 @@
 
 #include "Device.h"
 
+#include <algorithm>
+#include <thread>
+
 #include "Dispatch.h"
 #include "Platform.h"
 #include "LibraryPool.h"
+#include "DiskCache.h"
+#include "WorkerPool.h"
+#include "BufferAllocator.h"
+#include "BuiltinLibrary.h"
+#include "Environment.h"
 
 namespace cml {
 
+uint32_t GetCompilerThreadCount() {
+    auto threadCount = Environment::Read("CLMTL_COMPILER_THREADS", std::thread::hardware_concurrency() / 2);
+
+    return std::clamp<uint64_t>(threadCount, 1, 8);
+}
+
 Device *Device::GetSingleton() {
     static Device sDevice;
     return &sDevice;
@@ -51,9 +65,33 @@ LibraryPool *Device::GetLibraryPool() const {
     return mLibraryPool.get();
 }
 
+DiskCache *Device::GetCompileCache() const {
+    return mCompileCache.get();
+}
+
+DiskCache *Device::GetTranslationCache() const {
+    return mTranslationCache.get();
+}
+
+WorkerPool *Device::GetWorkerPool() const {
+    return mWorkerPool.get();
+}
+
+BufferAllocator *Device::GetBufferAllocator() const {
+    return mBufferAllocator.get();
+}
+
+BuiltinLibrary *Device::GetBuiltinLibrary() const {
+    return mBuiltinLibrary.get();
+}
+
 Device::Device() :
         _cl_device_id{Dispatch::GetTable()}, mDevice{MTL::CreateSystemDefaultDevice()},
-        mLibraryPool{std::make_unique<LibraryPool>(this)} {
+        mLibraryPool{std::make_unique<LibraryPool>(this)}, mCompileCache{std::make_unique<DiskCache>("spirv")},
+        mTranslationCache{std::make_unique<DiskCache>("msl")},
+        mWorkerPool{std::make_unique<WorkerPool>(GetCompilerThreadCount())},
+        mBufferAllocator{std::make_unique<BufferAllocator>(this)},
+        mBuiltinLibrary{std::make_unique<BuiltinLibrary>(this)} {
     InitLimits();
     InitSupportedPixelFormats();
 }
@@ -110,6 +148,9 @@ void Device::InitLimits() {
     mLimits.Profile = Platform::GetProfile();
     mLimits.Version = Platform::GetVersion();
     mLimits.Extensions = "cl_khr_fp16 cles_khr_int64";
+#ifdef cl_khr_command_buffer
+    mLimits.Extensions += " cl_khr_command_buffer";
+#endif
     mLimits.Platform = Platform::GetSingleton();
     mLimits.DoubleFpConfig = CL_FP_FMA | CL_FP_ROUND_TO_NEAREST | CL_FP_ROUND_TO_ZERO | CL_FP_ROUND_TO_INF |
                              CL_FP_INF_NAN | CL_FP_DENORM;
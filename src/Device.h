@@ -19,6 +19,7 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include <CL/cl_icd.h>
 
 #include "Metal.hpp"
@@ -39,6 +40,10 @@ namespace cml {
 
 class Platform;
 class LibraryPool;
+class DiskCache;
+class WorkerPool;
+class BufferAllocator;
+class BuiltinLibrary;
 
 struct DeviceLimits {
     cl_device_type Type;
@@ -116,12 +121,22 @@ public:
     DeviceLimits GetLimits() const;
     std::vector<MTL::PixelFormat> GetSupportedPixelFormats() const;
     LibraryPool *GetLibraryPool() const;
+    DiskCache *GetCompileCache() const;
+    DiskCache *GetTranslationCache() const;
+    WorkerPool *GetWorkerPool() const;
+    BufferAllocator *GetBufferAllocator() const;
+    BuiltinLibrary *GetBuiltinLibrary() const;
 
 private:
     MTL::Device *mDevice;
     DeviceLimits mLimits;
     std::vector<MTL::PixelFormat> mSupportedPixelFormats;
     std::unique_ptr<LibraryPool> mLibraryPool;
+    std::unique_ptr<DiskCache> mCompileCache;
+    std::unique_ptr<DiskCache> mTranslationCache;
+    std::unique_ptr<WorkerPool> mWorkerPool;
+    std::unique_ptr<BufferAllocator> mBufferAllocator;
+    std::unique_ptr<BuiltinLibrary> mBuiltinLibrary;
 
     Device();
     void InitLimits();
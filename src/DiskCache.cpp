@@ -0,0 +1,213 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include "DiskCache.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <algorithm>
+#include <unistd.h>
+
+#include "Environment.h"
+
+namespace cml {
+
+constexpr uint64_t DefaultCacheSize = 256 << 20;
+constexpr auto EntryExtension = ".bin";
+
+std::filesystem::path GetRootDirectory() {
+    if (auto directory = std::getenv("CLMTL_CACHE_DIR")) {
+        return directory;
+    }
+
+    if (auto home = std::getenv("HOME")) {
+        return std::filesystem::path(home) / "Library" / "Caches" / "clmtl";
+    }
+
+    return {};
+}
+
+bool IsEntry(const std::filesystem::directory_entry &entry) {
+    std::error_code error;
+
+    return entry.is_regular_file(error) && entry.path().extension() == EntryExtension;
+}
+
+DiskCache::DiskCache(const std::string &name)
+    : mDirectory{}, mCapacity{Environment::Read("CLMTL_CACHE_SIZE", DefaultCacheSize)}, mSize{0}, mHitCount{0}
+    , mMissCount{0}, mStoreCount{0}, mMutex{} {
+    InitDirectory(name);
+    InitSize();
+}
+
+bool DiskCache::Load(const Digest &key, std::vector<uint8_t> &data) {
+    if (mDirectory.empty()) {
+        ++mMissCount;
+        return false;
+    }
+
+    auto path = GetPath(key);
+    std::error_code error;
+
+    auto size = std::filesystem::file_size(path, error);
+    std::ifstream stream(path, std::ios::binary);
+
+    if (error || !stream) {
+        ++mMissCount;
+        return false;
+    }
+
+    data.resize(size);
+
+    if (!stream.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(size))) {
+        ++mMissCount;
+        return false;
+    }
+
+    // The modification time doubles as the access time for the LRU eviction.
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    ++mHitCount;
+
+    return true;
+}
+
+void DiskCache::Store(const Digest &key, const std::vector<uint8_t> &data) {
+    if (mDirectory.empty() || data.size() > mCapacity) {
+        return;
+    }
+
+    auto path = GetPath(key);
+    auto temporaryPath = path;
+    std::error_code error;
+
+    temporaryPath += ".tmp." + std::to_string(getpid()) + "." + std::to_string(mStoreCount.fetch_add(1));
+
+    std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+
+    stream.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+    stream.close();
+
+    if (!stream) {
+        std::filesystem::remove(temporaryPath, error);
+        return;
+    }
+
+    std::lock_guard lock(mMutex);
+
+    // A rewritten entry replaces the old file, so only the difference counts towards the size.
+    auto oldSize = std::filesystem::file_size(path, error);
+
+    if (error) {
+        oldSize = 0;
+    }
+
+    // Readers never observe a partially written entry because the rename is atomic.
+    std::filesystem::rename(temporaryPath, path, error);
+
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+        return;
+    }
+
+    mSize = mSize - std::min<uint64_t>(mSize, oldSize) + data.size();
+
+    if (mSize > mCapacity) {
+        Evict();
+    }
+}
+
+std::filesystem::path DiskCache::GetDirectory() const {
+    return mDirectory;
+}
+
+uint64_t DiskCache::GetCapacity() const {
+    return mCapacity;
+}
+
+uint64_t DiskCache::GetHitCount() const {
+    return mHitCount;
+}
+
+uint64_t DiskCache::GetMissCount() const {
+    return mMissCount;
+}
+
+void DiskCache::InitDirectory(const std::string &name) {
+    auto root = GetRootDirectory();
+
+    if (root.empty() || !mCapacity) {
+        return;
+    }
+
+    std::error_code error;
+
+    std::filesystem::create_directories(root / name, error);
+
+    if (!error) {
+        mDirectory = root / name;
+    }
+}
+
+void DiskCache::InitSize() {
+    if (mDirectory.empty()) {
+        return;
+    }
+
+    std::error_code error;
+
+    for (auto &entry : std::filesystem::directory_iterator(mDirectory, error)) {
+        if (IsEntry(entry)) {
+            mSize += entry.file_size(error);
+        }
+    }
+}
+
+void DiskCache::Evict() {
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::directory_entry>> entries;
+    std::error_code error;
+
+    mSize = 0;
+
+    for (auto &entry : std::filesystem::directory_iterator(mDirectory, error)) {
+        if (IsEntry(entry)) {
+            entries.emplace_back(entry.last_write_time(error), entry);
+            mSize += entry.file_size(error);
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](auto &lhs, auto &rhs) {
+        return lhs.first < rhs.first;
+    });
+
+    // Evict down to three quarters of the capacity so that every store doesn't rescan the directory.
+    for (auto &[time, entry] : entries) {
+        if (mSize <= mCapacity / 4 * 3) {
+            break;
+        }
+
+        auto size = entry.file_size(error);
+
+        if (std::filesystem::remove(entry.path(), error)) {
+            mSize -= std::min(mSize, static_cast<uint64_t>(size));
+        }
+    }
+}
+
+std::filesystem::path DiskCache::GetPath(const Digest &key) const {
+    return mDirectory / (Hasher::ConvertToString(key) + EntryExtension);
+}
+
+} //namespace cml
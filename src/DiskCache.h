@@ -0,0 +1,58 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_DISK_CACHE_H
+#define CLMTL_DISK_CACHE_H
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <filesystem>
+
+#include "Hash.h"
+
+namespace cml {
+
+class DiskCache {
+public:
+    explicit DiskCache(const std::string &name);
+    bool Load(const Digest &key, std::vector<uint8_t> &data);
+    void Store(const Digest &key, const std::vector<uint8_t> &data);
+    std::filesystem::path GetDirectory() const;
+    uint64_t GetCapacity() const;
+    uint64_t GetHitCount() const;
+    uint64_t GetMissCount() const;
+
+private:
+    std::filesystem::path mDirectory;
+    uint64_t mCapacity;
+    uint64_t mSize;
+    std::atomic<uint64_t> mHitCount;
+    std::atomic<uint64_t> mMissCount;
+    std::atomic<uint64_t> mStoreCount;
+    std::mutex mMutex;
+
+    void InitDirectory(const std::string &name);
+    void InitSize();
+    void Evict();
+    std::filesystem::path GetPath(const Digest &key) const;
+};
+
+} //namespace cml
+
+#endif //CLMTL_DISK_CACHE_H
@@ -14,9 +14,11 @@
 * limitations under the License.
 ***********************************************************************************************************************/
 
+#include <unordered_map>
 #include <CL/cl_icd.h>
 
 #include "Dispatch.h"
+#include "Extension.h"
 
 namespace cml {
 
@@ -130,6 +132,31 @@ void *Dispatch::GetExtensionSymbol(const std::string &symbolName) {
         return reinterpret_cast<void *>(&clIcdGetPlatformIDsKHR);
     }
 
+#ifdef cl_khr_command_buffer
+    static const std::unordered_map<std::string, void *> sCommandBufferSymbols{
+            {"clCreateCommandBufferKHR", reinterpret_cast<void *>(&clCreateCommandBufferKHR)},
+            {"clFinalizeCommandBufferKHR", reinterpret_cast<void *>(&clFinalizeCommandBufferKHR)},
+            {"clRetainCommandBufferKHR", reinterpret_cast<void *>(&clRetainCommandBufferKHR)},
+            {"clReleaseCommandBufferKHR", reinterpret_cast<void *>(&clReleaseCommandBufferKHR)},
+            {"clEnqueueCommandBufferKHR", reinterpret_cast<void *>(&clEnqueueCommandBufferKHR)},
+            {"clCommandBarrierWithWaitListKHR", reinterpret_cast<void *>(&clCommandBarrierWithWaitListKHR)},
+            {"clCommandCopyBufferKHR", reinterpret_cast<void *>(&clCommandCopyBufferKHR)},
+            {"clCommandCopyBufferRectKHR", reinterpret_cast<void *>(&clCommandCopyBufferRectKHR)},
+            {"clCommandCopyBufferToImageKHR", reinterpret_cast<void *>(&clCommandCopyBufferToImageKHR)},
+            {"clCommandCopyImageKHR", reinterpret_cast<void *>(&clCommandCopyImageKHR)},
+            {"clCommandCopyImageToBufferKHR", reinterpret_cast<void *>(&clCommandCopyImageToBufferKHR)},
+            {"clCommandFillBufferKHR", reinterpret_cast<void *>(&clCommandFillBufferKHR)},
+            {"clCommandFillImageKHR", reinterpret_cast<void *>(&clCommandFillImageKHR)},
+            {"clCommandNDRangeKernelKHR", reinterpret_cast<void *>(&clCommandNDRangeKernelKHR)},
+            {"clGetCommandBufferInfoKHR", reinterpret_cast<void *>(&clGetCommandBufferInfoKHR)},
+            {"clUpdateMutableCommandArgCLMTL", reinterpret_cast<void *>(&clUpdateMutableCommandArgCLMTL)}
+    };
+
+    if (sCommandBufferSymbols.contains(symbolName)) {
+        return sCommandBufferSymbols.at(symbolName);
+    }
+#endif
+
     return nullptr;
 }
 
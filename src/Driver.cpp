@@ -15,6 +15,9 @@
 ***********************************************************************************************************************/
 
 #include <sstream>
+#include <map>
+#include <bit>
+#include <unistd.h>
 #include <CL/cl_icd.h>
 
 #include "Util.h"
@@ -30,6 +33,9 @@
 #include "Kernel.h"
 #include "Event.h"
 #include "Sampler.h"
+#include "WorkerPool.h"
+#include "CommandBuffer.h"
+#include "Extension.h"
 
 /***********************************************************************************************************************
 * OpenCL Core APIs
@@ -549,9 +555,7 @@ cl_int clReleaseContext(cl_context context) {
         return CL_INVALID_CONTEXT;
     }
 
-    cmlContext->Release();
-
-    if (!cmlContext->GetReferenceCount()) {
+    if (!cmlContext->Release()) {
         delete cmlContext;
     }
 
@@ -618,7 +622,84 @@ cl_int clSetContextDestructorCallback(cl_context context, void (*pfn_notify)(cl_
 
 cl_command_queue clCreateCommandQueueWithProperties(cl_context context, cl_device_id device,
                                                     const cl_queue_properties *properties, cl_int *errcode_ret) {
-    return nullptr;
+    auto cmlContext = cml::Context::DownCast(context);
+
+    if (!cmlContext) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_CONTEXT;
+        }
+
+        return nullptr;
+    }
+
+    auto cmlDevice = cml::Device::DownCast(device);
+
+    if (!cmlDevice || cmlDevice != cmlContext->GetDevice()) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_DEVICE;
+        }
+
+        return nullptr;
+    }
+
+    cl_command_queue_properties queueProperties = 0;
+    std::map<cl_queue_properties, cl_queue_properties> flushProperties;
+
+    for (auto iter = properties; iter && *iter != 0; iter += 2) {
+        switch (iter[0]) {
+            case CL_QUEUE_PROPERTIES:
+                queueProperties = iter[1];
+                break;
+            case CL_QUEUE_FLUSH_COMMAND_COUNT_CLMTL:
+            case CL_QUEUE_FLUSH_BYTE_COUNT_CLMTL:
+            case CL_QUEUE_FLUSH_WORK_COUNT_CLMTL:
+            case CL_QUEUE_FLUSH_INTERVAL_CLMTL:
+            case CL_QUEUE_FLUSH_IDLE_COMMAND_COUNT_CLMTL:
+                flushProperties[iter[0]] = iter[1];
+                break;
+            default:
+                if (errcode_ret) {
+                    errcode_ret[0] = CL_INVALID_VALUE;
+                }
+
+                return nullptr;
+        }
+    }
+
+    auto cmlCommandQueue = new cml::CommandQueue(cmlContext, cmlDevice, queueProperties);
+    assert(cmlCommandQueue);
+
+    auto flushPolicy = cmlCommandQueue->GetFlushPolicy();
+
+    for (auto &[key, value] : flushProperties) {
+        switch (key) {
+            case CL_QUEUE_FLUSH_COMMAND_COUNT_CLMTL:
+                flushPolicy.CommandCount = value;
+                break;
+            case CL_QUEUE_FLUSH_BYTE_COUNT_CLMTL:
+                flushPolicy.ByteCount = value;
+                break;
+            case CL_QUEUE_FLUSH_WORK_COUNT_CLMTL:
+                flushPolicy.WorkCount = value;
+                break;
+            case CL_QUEUE_FLUSH_INTERVAL_CLMTL:
+                flushPolicy.Interval = value;
+                break;
+            case CL_QUEUE_FLUSH_IDLE_COMMAND_COUNT_CLMTL:
+                flushPolicy.IdleCommandCount = value;
+                break;
+            default:
+                break;
+        }
+    }
+
+    cmlCommandQueue->SetFlushPolicy(flushPolicy);
+
+    if (errcode_ret) {
+        errcode_ret[0] = CL_SUCCESS;
+    }
+
+    return cmlCommandQueue;
 }
 
 #endif
@@ -642,9 +723,7 @@ cl_int clReleaseCommandQueue(cl_command_queue command_queue) {
         return CL_INVALID_COMMAND_QUEUE;
     }
 
-    cmlCommandQueue->Release();
-
-    if (!cmlCommandQueue->GetReferenceCount()) {
+    if (!cmlCommandQueue->Release()) {
         delete cmlCommandQueue;
     }
 
@@ -780,11 +859,22 @@ cl_mem clCreateSubBuffer(cl_mem buffer, cl_mem_flags flags, cl_buffer_create_typ
         return nullptr;
     }
 
+    auto region = static_cast<const cl_buffer_region *>(buffer_create_info);
+
+    // Buffers wrapping host memory have no heap, so sub-buffers must start on a page to wrap it as well.
+    if (!cmlBuffer->GetHeap() && region->origin % getpagesize()) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_MISALIGNED_SUB_BUFFER_OFFSET;
+        }
+
+        return nullptr;
+    }
+
     if (errcode_ret) {
         errcode_ret[0] = CL_SUCCESS;
     }
 
-    return new cml::Buffer(cmlBuffer, flags, static_cast<const cl_buffer_region *>(buffer_create_info));
+    return new cml::Buffer(cmlBuffer, flags, region);
 }
 
 cl_mem clCreateImage(cl_context context, cl_mem_flags flags, const cl_image_format *image_format,
@@ -847,9 +937,15 @@ cl_mem clCreateImage(cl_context context, cl_mem_flags flags, const cl_image_form
         errcode_ret[0] = CL_SUCCESS;
     }
 
-    return new cml::Image(cmlContext, flags, *image_format, image_desc->image_type,
-                          std::max(image_desc->image_width, 1ul), std::max(image_desc->image_height, 1ul),
-                          std::max(image_desc->image_depth, 1ul));
+    // Metal only accepts a height for 2D or 3D textures and a depth for 3D textures.
+    auto type = image_desc->image_type;
+    auto height = type == CL_MEM_OBJECT_IMAGE1D || type == CL_MEM_OBJECT_IMAGE1D_ARRAY ? 1 : image_desc->image_height;
+    auto depth = type == CL_MEM_OBJECT_IMAGE3D ? image_desc->image_depth : 1;
+    auto arraySize = type == CL_MEM_OBJECT_IMAGE1D_ARRAY || type == CL_MEM_OBJECT_IMAGE2D_ARRAY ?
+                     image_desc->image_array_size : 1;
+
+    return new cml::Image(cmlContext, flags, *image_format, type, std::max(image_desc->image_width, 1ul),
+                          std::max(height, 1ul), std::max(depth, 1ul), std::max(arraySize, 1ul));
 }
 
 #ifdef CL_VERSION_2_0
@@ -895,9 +991,7 @@ cl_int clReleaseMemObject(cl_mem memobj) {
         return CL_INVALID_MEM_OBJECT;
     }
 
-    cmlMemory->Release();
-
-    if (!cmlMemory->GetReferenceCount()) {
+    if (!cmlMemory->Release()) {
         delete cmlMemory;
     }
 
@@ -951,7 +1045,7 @@ cl_int clGetMemObjectInfo(cl_mem memobj, cl_mem_info param_name, size_t param_va
             break;
         case CL_MEM_HOST_PTR:
             size = sizeof(void *);
-            memset(info, 0, size);
+            ((void **) info)[0] = cmlMemory->GetHostPtr();
             break;
         case CL_MEM_MAP_COUNT:
             size = sizeof(cl_uint);
@@ -1024,6 +1118,10 @@ cl_int clGetImageInfo(cl_mem image, cl_image_info param_name, size_t param_value
             size = sizeof(size_t);
             *((size_t *) info) = cmlImage->GetDepth();
             break;
+        case CL_IMAGE_ARRAY_SIZE:
+            size = sizeof(size_t);
+            *((size_t *) info) = cmlImage->GetArraySize();
+            break;
         default:
             return CL_INVALID_VALUE;
     }
@@ -1104,9 +1202,7 @@ cl_int clReleaseSampler(cl_sampler sampler) {
         return CL_INVALID_SAMPLER;
     }
 
-    cmlSampler->Release();
-
-    if (!cmlSampler->GetReferenceCount()) {
+    if (!cmlSampler->Release()) {
         delete cmlSampler;
     }
 
@@ -1334,9 +1430,7 @@ cl_int clReleaseProgram(cl_program program) {
         return CL_INVALID_PROGRAM;
     }
 
-    cmlProgram->Retain();
-
-    if (!cmlProgram->GetReferenceCount()) {
+    if (!cmlProgram->Release()) {
         delete cmlProgram;
     }
 
@@ -1369,32 +1463,197 @@ cl_int clBuildProgram(cl_program program, cl_uint num_devices, const cl_device_i
         return CL_INVALID_PROGRAM;
     }
 
+    if (!cmlProgram->BeginBuild()) {
+        return CL_INVALID_OPERATION;
+    }
+
     if (options) {
         cmlProgram->SetOptions(options);
     }
 
-    cmlProgram->Compile();
+    if (pfn_notify) {
+        cmlProgram->Retain();
+
+        cmlProgram->GetContext()->GetDevice()->GetWorkerPool()->Submit([cmlProgram, pfn_notify, user_data]() {
+            cmlProgram->Build();
+            pfn_notify(cmlProgram, user_data);
+
+            if (!cmlProgram->Release()) {
+                delete cmlProgram;
+            }
+        });
+
+        return CL_SUCCESS;
+    }
+
+    cmlProgram->Build();
 
     if (cmlProgram->GetBuildStatus() != CL_BUILD_SUCCESS) {
         return CL_BUILD_PROGRAM_FAILURE;
     }
 
-    cmlProgram->Reflect();
-
     return CL_SUCCESS;
 }
 
 cl_int clCompileProgram(cl_program program, cl_uint num_devices, const cl_device_id *device_list, const char *options,
                         cl_uint num_input_headers, const cl_program *input_headers, const char **header_include_names,
                         void (CL_CALLBACK *pfn_notify)(cl_program program, void *user_data), void *user_data) {
-    return CL_INVALID_PROGRAM;
+    if (num_devices && !device_list) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (!num_devices && device_list) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (!pfn_notify && user_data) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (num_input_headers && (!input_headers || !header_include_names)) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (!num_input_headers && (input_headers || header_include_names)) {
+        return CL_INVALID_VALUE;
+    }
+
+    for (auto i = 0; i != num_devices; ++i) {
+        if (!cml::Device::DownCast(device_list[i])) {
+            return CL_INVALID_DEVICE;
+        }
+    }
+
+    auto cmlProgram = cml::Program::DownCast(program);
+
+    if (!cmlProgram) {
+        return CL_INVALID_PROGRAM;
+    }
+
+    std::map<std::string, std::string> headers;
+
+    for (auto i = 0; i != num_input_headers; ++i) {
+        auto cmlHeader = cml::Program::DownCast(input_headers[i]);
+
+        if (!cmlHeader) {
+            return CL_INVALID_PROGRAM;
+        }
+
+        if (!header_include_names[i] || !cml::Program::IsValidHeaderName(header_include_names[i])) {
+            return CL_INVALID_VALUE;
+        }
+
+        headers[header_include_names[i]] = cmlHeader->GetSource();
+    }
+
+    if (!cmlProgram->BeginBuild()) {
+        return CL_INVALID_OPERATION;
+    }
+
+    if (options) {
+        cmlProgram->SetOptions(options);
+    }
+
+    cmlProgram->SetHeaders(headers);
+    cmlProgram->Compile();
+    cmlProgram->EndBuild();
+
+    if (pfn_notify) {
+        pfn_notify(cmlProgram, user_data);
+    }
+
+    if (cmlProgram->GetBuildStatus() != CL_BUILD_SUCCESS) {
+        return CL_COMPILE_PROGRAM_FAILURE;
+    }
+
+    return CL_SUCCESS;
 }
 
 cl_program clLinkProgram(cl_context context, cl_uint num_devices, const cl_device_id *device_list, const char *options,
                          cl_uint num_input_programs, const cl_program *input_programs,
                          void (*pfn_notify)(cl_program program, void *user_data), void *user_data,
                          cl_int *errcode_ret) {
-    return nullptr;
+    if ((num_devices && !device_list) || (!num_devices && device_list) || (!pfn_notify && user_data) ||
+        !num_input_programs || !input_programs) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_VALUE;
+        }
+
+        return nullptr;
+    }
+
+    auto cmlContext = cml::Context::DownCast(context);
+
+    if (!cmlContext) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_CONTEXT;
+        }
+
+        return nullptr;
+    }
+
+    std::vector<std::vector<uint32_t>> binaries;
+
+    for (auto i = 0; i != num_input_programs; ++i) {
+        auto cmlInputProgram = cml::Program::DownCast(input_programs[i]);
+
+        if (!cmlInputProgram) {
+            if (errcode_ret) {
+                errcode_ret[0] = CL_INVALID_PROGRAM;
+            }
+
+            return nullptr;
+        }
+
+        cmlInputProgram->WaitBuild();
+
+        auto binary = cmlInputProgram->GetBinary();
+
+        if (cmlInputProgram->GetBuildStatus() != CL_BUILD_SUCCESS || binary.empty()) {
+            if (errcode_ret) {
+                errcode_ret[0] = CL_INVALID_OPERATION;
+            }
+
+            return nullptr;
+        }
+
+        binaries.emplace_back(binary.begin(), binary.end());
+    }
+
+    auto cmlProgram = new cml::Program(cmlContext);
+    assert(cmlProgram);
+
+    if (options) {
+        cmlProgram->SetOptions(options);
+    }
+
+    cmlProgram->Link(binaries);
+
+    if (cmlProgram->GetBuildStatus() == CL_BUILD_SUCCESS) {
+        try {
+            cmlProgram->Reflect();
+            cmlProgram->Translate();
+        } catch (std::exception &e) {
+            cmlProgram->Release();
+            delete cmlProgram;
+
+            if (errcode_ret) {
+                errcode_ret[0] = CL_LINK_PROGRAM_FAILURE;
+            }
+
+            return nullptr;
+        }
+    }
+
+    if (pfn_notify) {
+        pfn_notify(cmlProgram, user_data);
+    }
+
+    if (errcode_ret) {
+        errcode_ret[0] = cmlProgram->GetBuildStatus() == CL_BUILD_SUCCESS ? CL_SUCCESS : CL_LINK_PROGRAM_FAILURE;
+    }
+
+    return cmlProgram;
 }
 
 #ifdef CL_VERSION_2_2
@@ -1517,6 +1776,10 @@ cl_int clGetProgramBuildInfo(cl_program program, cl_device_id device, cl_program
             size = cmlProgram->GetLog().size() + 1;
             memcpy(info, cmlProgram->GetLog().data(), size);
             break;
+        case CL_PROGRAM_BINARY_TYPE:
+            size = sizeof(cl_program_binary_type);
+            *((cl_program_binary_type *) info) = cmlProgram->GetBinaryType();
+            break;
         default:
             return CL_INVALID_VALUE;
     }
@@ -1559,6 +1822,16 @@ cl_kernel clCreateKernel(cl_program program, const char *kernel_name, cl_int *er
         return nullptr;
     }
 
+    cmlProgram->WaitBuild();
+
+    if (cmlProgram->GetBuildStatus() != CL_BUILD_SUCCESS) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_PROGRAM_EXECUTABLE;
+        }
+
+        return nullptr;
+    }
+
     cml::Kernel *cmlKernel;
 
     try {
@@ -1585,6 +1858,12 @@ cl_int clCreateKernelsInProgram(cl_program program, cl_uint num_kernels, cl_kern
         return CL_INVALID_PROGRAM;
     }
 
+    cmlProgram->WaitBuild();
+
+    if (cmlProgram->GetBuildStatus() != CL_BUILD_SUCCESS) {
+        return CL_INVALID_PROGRAM_EXECUTABLE;
+    }
+
     auto reflection = cmlProgram->GetReflection();
 
     if (kernels) {
@@ -1631,9 +1910,7 @@ cl_int clReleaseKernel(cl_kernel kernel) {
         return CL_INVALID_KERNEL;
     }
 
-    cmlKernel->Release();
-
-    if (!cmlKernel->GetReferenceCount()) {
+    if (!cmlKernel->Release()) {
         delete cmlKernel;
     }
 
@@ -1647,7 +1924,7 @@ cl_int clSetKernelArg(cl_kernel kernel, cl_uint arg_index, size_t arg_size, cons
         return CL_INVALID_KERNEL;
     }
 
-    auto cmlArgTable = cmlKernel->GetArgTable();
+    auto &cmlArgTable = cmlKernel->GetArgTable();
 
     if (arg_index >= cmlArgTable.size()) {
         return CL_INVALID_ARG_INDEX;
@@ -1804,13 +2081,19 @@ cl_int clWaitForEvents(cl_uint num_events, const cl_event *event_list) {
     }
 
     for (auto i = 0; i != num_events; ++i) {
-        auto cmlEvent = cml::Event::DownCast(event_list[i]);
-
-        if (!cmlEvent) {
+        if (!cml::Event::DownCast(event_list[i])) {
             return CL_INVALID_EVENT;
         }
+    }
 
-        cmlEvent->WaitComplete();
+    // Submit everything before waiting on anything. Events from the same command buffer share a serial, so each
+    // queue is flushed at most once.
+    for (auto i = 0; i != num_events; ++i) {
+        cml::Event::DownCast(event_list[i])->Flush();
+    }
+
+    for (auto i = 0; i != num_events; ++i) {
+        cml::Event::DownCast(event_list[i])->WaitComplete();
     }
 
     return CL_SUCCESS;
@@ -1904,9 +2187,7 @@ cl_int clReleaseEvent(cl_event event) {
         return CL_INVALID_EVENT;
     }
 
-    cmlEvent->Release();
-
-    if (!cmlEvent->GetReferenceCount()) {
+    if (!cmlEvent->Release()) {
         delete cmlEvent;
     }
 
@@ -1959,7 +2240,60 @@ cl_int clSetEventCallback(cl_event event, cl_int command_exec_callback_type,
 
 cl_int clGetEventProfilingInfo(cl_event event, cl_profiling_info param_name, size_t param_value_size, void *param_value,
                                size_t *param_value_size_ret) {
-    return CL_INVALID_EVENT;
+    auto cmlEvent = cml::Event::DownCast(event);
+
+    if (!cmlEvent) {
+        return CL_INVALID_EVENT;
+    }
+
+    // The queue may already be released, so the event records whether it profiles. START and END are the GPU times of
+    // the whole command buffer that held the command, which also cover earlier commands of it without an event.
+    if (!cmlEvent->IsProfiling() || cmlEvent->GetStatus() != CL_COMPLETE) {
+        return CL_PROFILING_INFO_NOT_AVAILABLE;
+    }
+
+    auto profilingInfo = cmlEvent->GetProfilingInfo();
+    size_t size;
+    uint8_t info[2048];
+
+    switch (param_name) {
+        case CL_PROFILING_COMMAND_QUEUED:
+            size = sizeof(cl_ulong);
+            ((cl_ulong *) info)[0] = profilingInfo.Queued;
+            break;
+        case CL_PROFILING_COMMAND_SUBMIT:
+            size = sizeof(cl_ulong);
+            ((cl_ulong *) info)[0] = profilingInfo.Submit;
+            break;
+        case CL_PROFILING_COMMAND_START:
+            size = sizeof(cl_ulong);
+            ((cl_ulong *) info)[0] = profilingInfo.Start;
+            break;
+        case CL_PROFILING_COMMAND_END:
+            size = sizeof(cl_ulong);
+            ((cl_ulong *) info)[0] = profilingInfo.End;
+            break;
+        case CL_PROFILING_COMMAND_COMPLETE:
+            size = sizeof(cl_ulong);
+            ((cl_ulong *) info)[0] = profilingInfo.Complete;
+            break;
+        default:
+            return CL_INVALID_VALUE;
+    }
+
+    if (param_value) {
+        if (param_value_size < size) {
+            return CL_INVALID_VALUE;
+        } else {
+            memcpy(param_value, info, size);
+        }
+    }
+
+    if (param_value_size_ret) {
+        param_value_size_ret[0] = size;
+    }
+
+    return CL_SUCCESS;
 }
 
 /***********************************************************************************************************************
@@ -2024,7 +2358,7 @@ cl_int clEnqueueReadBuffer(cl_command_queue command_queue, cl_mem buffer, cl_boo
         return CL_INVALID_MEM_OBJECT;
     }
 
-    cmlCommandQueue->EnqueueReadBuffer(cmlBuffer, offset, ptr, size);
+    cmlCommandQueue->EnqueueReadBuffer(cmlBuffer, offset, ptr, size, blocking_read);
 
     if (event) {
         auto cmlEvent = new cml::Event(cmlCommandQueue);
@@ -2034,7 +2368,7 @@ cl_int clEnqueueReadBuffer(cl_command_queue command_queue, cl_mem buffer, cl_boo
         event[0] = cmlEvent;
     }
 
-    if (blocking_read) {
+    if (blocking_read && !cmlCommandQueue->IsHostAccessible(cmlBuffer)) {
         cmlCommandQueue->Flush();
         cmlCommandQueue->WaitIdle();
     }
@@ -2047,13 +2381,11 @@ cl_int clEnqueueReadBufferRect(cl_command_queue command_queue, cl_mem buffer, cl
                                size_t buffer_row_pitch, size_t buffer_slice_pitch, size_t host_row_pitch,
                                size_t host_slice_pitch, void *ptr, cl_uint num_events_in_wait_list,
                                const cl_event *event_wait_list, cl_event *event) {
-    return CL_INVALID_COMMAND_QUEUE;
-}
+    if (!ptr || !buffer_origin || !host_origin || !region) {
+        return CL_INVALID_VALUE;
+    }
 
-cl_int clEnqueueWriteBuffer(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_write, size_t offset,
-                            size_t size, const void *ptr, cl_uint num_events_in_wait_list,
-                            const cl_event *event_wait_list, cl_event *event) {
-    if (!ptr) {
+    if (!region[0] || !region[1] || !region[2]) {
         return CL_INVALID_VALUE;
     }
 
@@ -2079,35 +2411,199 @@ cl_int clEnqueueWriteBuffer(cl_command_queue command_queue, cl_mem buffer, cl_bo
         return CL_INVALID_MEM_OBJECT;
     }
 
-    cmlCommandQueue->EnqueueWriteBuffer(ptr, cmlBuffer, offset, size);
+    if (!buffer_row_pitch) {
+        buffer_row_pitch = region[0];
+    }
 
-    if (event) {
-        auto cmlEvent = new cml::Event(cmlCommandQueue);
-        assert(cmlEvent);
+    if (!buffer_slice_pitch) {
+        buffer_slice_pitch = buffer_row_pitch * region[1];
+    }
 
-        cmlCommandQueue->EnqueueSignalEvent(cmlEvent);
-        event[0] = cmlEvent;
+    if (!host_row_pitch) {
+        host_row_pitch = region[0];
     }
 
-    if (blocking_write) {
-        cmlCommandQueue->Flush();
-        cmlCommandQueue->WaitIdle();
+    if (!host_slice_pitch) {
+        host_slice_pitch = host_row_pitch * region[1];
     }
 
-    return CL_SUCCESS;
-}
+    if (buffer_row_pitch < region[0] || buffer_slice_pitch < buffer_row_pitch * region[1] ||
+        host_row_pitch < region[0] || host_slice_pitch < host_row_pitch * region[1]) {
+        return CL_INVALID_VALUE;
+    }
 
-cl_int clEnqueueWriteBufferRect(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_write,
+    if (buffer_slice_pitch % buffer_row_pitch || host_slice_pitch % host_row_pitch) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (cml::Util::GetRectEnd({buffer_origin[0], buffer_origin[1], buffer_origin[2]}, {region[0], region[1], region[2]},
+                              buffer_row_pitch, buffer_slice_pitch) > cmlBuffer->GetSize()) {
+        return CL_INVALID_VALUE;
+    }
+
+    cmlCommandQueue->EnqueueReadBufferRect(cmlBuffer, {buffer_origin[0], buffer_origin[1], buffer_origin[2]},
+                                           buffer_row_pitch, buffer_slice_pitch, ptr,
+                                           {host_origin[0], host_origin[1], host_origin[2]}, host_row_pitch,
+                                           host_slice_pitch, {region[0], region[1], region[2]}, blocking_read);
+
+    if (event) {
+        auto cmlEvent = new cml::Event(cmlCommandQueue);
+        assert(cmlEvent);
+
+        cmlCommandQueue->EnqueueSignalEvent(cmlEvent);
+        event[0] = cmlEvent;
+    }
+
+    if (blocking_read && !cmlCommandQueue->IsHostAccessible(cmlBuffer)) {
+        cmlCommandQueue->Flush();
+        cmlCommandQueue->WaitIdle();
+    }
+
+    return CL_SUCCESS;
+}
+
+cl_int clEnqueueWriteBuffer(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_write, size_t offset,
+                            size_t size, const void *ptr, cl_uint num_events_in_wait_list,
+                            const cl_event *event_wait_list, cl_event *event) {
+    if (!ptr) {
+        return CL_INVALID_VALUE;
+    }
+
+    auto cmlCommandQueue = cml::CommandQueue::DownCast(command_queue);
+
+    if (!cmlCommandQueue) {
+        return CL_INVALID_COMMAND_QUEUE;
+    }
+
+    for (auto i = 0; i != num_events_in_wait_list; ++i) {
+        auto cmlEvent = cml::Event::DownCast(event_wait_list[i]);
+
+        if (!cmlEvent) {
+            return CL_INVALID_EVENT;
+        }
+
+        cmlCommandQueue->EnqueueWaitEvent(cmlEvent);
+    }
+
+    auto cmlBuffer = cml::Buffer::DownCast(buffer);
+
+    if (!cmlBuffer) {
+        return CL_INVALID_MEM_OBJECT;
+    }
+
+    cmlCommandQueue->EnqueueWriteBuffer(ptr, cmlBuffer, offset, size, blocking_write);
+
+    if (event) {
+        auto cmlEvent = new cml::Event(cmlCommandQueue);
+        assert(cmlEvent);
+
+        cmlCommandQueue->EnqueueSignalEvent(cmlEvent);
+        event[0] = cmlEvent;
+    }
+
+    if (blocking_write && !cmlCommandQueue->IsHostAccessible(cmlBuffer)) {
+        cmlCommandQueue->Flush();
+        cmlCommandQueue->WaitIdle();
+    }
+
+    return CL_SUCCESS;
+}
+
+cl_int clEnqueueWriteBufferRect(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_write,
                                 const size_t *buffer_origin, const size_t *host_origin, const size_t *region,
                                 size_t buffer_row_pitch, size_t buffer_slice_pitch, size_t host_row_pitch,
                                 size_t host_slice_pitch, const void *ptr, cl_uint num_events_in_wait_list,
                                 const cl_event *event_wait_list, cl_event *event) {
-    return CL_INVALID_COMMAND_QUEUE;
+    if (!ptr || !buffer_origin || !host_origin || !region) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (!region[0] || !region[1] || !region[2]) {
+        return CL_INVALID_VALUE;
+    }
+
+    auto cmlCommandQueue = cml::CommandQueue::DownCast(command_queue);
+
+    if (!cmlCommandQueue) {
+        return CL_INVALID_COMMAND_QUEUE;
+    }
+
+    for (auto i = 0; i != num_events_in_wait_list; ++i) {
+        auto cmlEvent = cml::Event::DownCast(event_wait_list[i]);
+
+        if (!cmlEvent) {
+            return CL_INVALID_EVENT;
+        }
+
+        cmlCommandQueue->EnqueueWaitEvent(cmlEvent);
+    }
+
+    auto cmlBuffer = cml::Buffer::DownCast(buffer);
+
+    if (!cmlBuffer) {
+        return CL_INVALID_MEM_OBJECT;
+    }
+
+    if (!buffer_row_pitch) {
+        buffer_row_pitch = region[0];
+    }
+
+    if (!buffer_slice_pitch) {
+        buffer_slice_pitch = buffer_row_pitch * region[1];
+    }
+
+    if (!host_row_pitch) {
+        host_row_pitch = region[0];
+    }
+
+    if (!host_slice_pitch) {
+        host_slice_pitch = host_row_pitch * region[1];
+    }
+
+    if (buffer_row_pitch < region[0] || buffer_slice_pitch < buffer_row_pitch * region[1] ||
+        host_row_pitch < region[0] || host_slice_pitch < host_row_pitch * region[1]) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (buffer_slice_pitch % buffer_row_pitch || host_slice_pitch % host_row_pitch) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (cml::Util::GetRectEnd({buffer_origin[0], buffer_origin[1], buffer_origin[2]}, {region[0], region[1], region[2]},
+                              buffer_row_pitch, buffer_slice_pitch) > cmlBuffer->GetSize()) {
+        return CL_INVALID_VALUE;
+    }
+
+    cmlCommandQueue->EnqueueWriteBufferRect(ptr, {host_origin[0], host_origin[1], host_origin[2]}, host_row_pitch,
+                                            host_slice_pitch, cmlBuffer,
+                                            {buffer_origin[0], buffer_origin[1], buffer_origin[2]}, buffer_row_pitch,
+                                            buffer_slice_pitch, {region[0], region[1], region[2]}, blocking_write);
+
+    if (event) {
+        auto cmlEvent = new cml::Event(cmlCommandQueue);
+        assert(cmlEvent);
+
+        cmlCommandQueue->EnqueueSignalEvent(cmlEvent);
+        event[0] = cmlEvent;
+    }
+
+    if (blocking_write && !cmlCommandQueue->IsHostAccessible(cmlBuffer)) {
+        cmlCommandQueue->Flush();
+        cmlCommandQueue->WaitIdle();
+    }
+
+    return CL_SUCCESS;
 }
 
 cl_int clEnqueueFillBuffer(cl_command_queue command_queue, cl_mem buffer, const void *pattern, size_t pattern_size,
                            size_t offset, size_t size, cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
                            cl_event *event) {
+    // The fill engine replicates the pattern in power of two periods of up to 128 bytes.
+    if (!pattern || !std::has_single_bit(pattern_size) || pattern_size > 128 || offset % pattern_size ||
+        size % pattern_size) {
+        return CL_INVALID_VALUE;
+    }
+
     auto cmlCommandQueue = cml::CommandQueue::DownCast(command_queue);
 
     if (!cmlCommandQueue) {
@@ -2120,6 +2616,10 @@ cl_int clEnqueueFillBuffer(cl_command_queue command_queue, cl_mem buffer, const
         return CL_INVALID_MEM_OBJECT;
     }
 
+    if (offset + size > cmlBuffer->GetSize()) {
+        return CL_INVALID_VALUE;
+    }
+
     for (auto i = 0; i != num_events_in_wait_list; ++i) {
         auto cmlEvent = cml::Event::DownCast(event_wait_list[i]);
 
@@ -2192,7 +2692,100 @@ cl_int clEnqueueCopyBufferRect(cl_command_queue command_queue, cl_mem src_buffer
                                size_t src_row_pitch, size_t src_slice_pitch, size_t dst_row_pitch,
                                size_t dst_slice_pitch, cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
                                cl_event *event) {
-    return CL_INVALID_COMMAND_QUEUE;
+    if (!src_origin || !dst_origin || !region) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (!region[0] || !region[1] || !region[2]) {
+        return CL_INVALID_VALUE;
+    }
+
+    auto cmlCommandQueue = cml::CommandQueue::DownCast(command_queue);
+
+    if (!cmlCommandQueue) {
+        return CL_INVALID_COMMAND_QUEUE;
+    }
+
+    for (auto i = 0; i != num_events_in_wait_list; ++i) {
+        auto cmlEvent = cml::Event::DownCast(event_wait_list[i]);
+
+        if (!cmlEvent) {
+            return CL_INVALID_EVENT;
+        }
+
+        cmlCommandQueue->EnqueueWaitEvent(cmlEvent);
+    }
+
+    auto cmlSrcBuffer = cml::Buffer::DownCast(src_buffer);
+
+    if (!cmlSrcBuffer) {
+        return CL_INVALID_MEM_OBJECT;
+    }
+
+    auto cmlDstBuffer = cml::Buffer::DownCast(dst_buffer);
+
+    if (!cmlDstBuffer) {
+        return CL_INVALID_MEM_OBJECT;
+    }
+
+    if (!src_row_pitch) {
+        src_row_pitch = region[0];
+    }
+
+    if (!src_slice_pitch) {
+        src_slice_pitch = src_row_pitch * region[1];
+    }
+
+    if (!dst_row_pitch) {
+        dst_row_pitch = region[0];
+    }
+
+    if (!dst_slice_pitch) {
+        dst_slice_pitch = dst_row_pitch * region[1];
+    }
+
+    if (src_row_pitch < region[0] || src_slice_pitch < src_row_pitch * region[1] ||
+        dst_row_pitch < region[0] || dst_slice_pitch < dst_row_pitch * region[1]) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (src_slice_pitch % src_row_pitch || dst_slice_pitch % dst_row_pitch) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (cml::Util::GetRectEnd({src_origin[0], src_origin[1], src_origin[2]}, {region[0], region[1], region[2]},
+                              src_row_pitch, src_slice_pitch) > cmlSrcBuffer->GetSize() ||
+        cml::Util::GetRectEnd({dst_origin[0], dst_origin[1], dst_origin[2]}, {region[0], region[1], region[2]},
+                              dst_row_pitch, dst_slice_pitch) > cmlDstBuffer->GetSize()) {
+        return CL_INVALID_VALUE;
+    }
+
+    // Copies within one buffer must use the same layout for both regions, and the regions must not overlap.
+    if (cmlSrcBuffer == cmlDstBuffer) {
+        if (src_row_pitch != dst_row_pitch || src_slice_pitch != dst_slice_pitch) {
+            return CL_INVALID_VALUE;
+        }
+
+        if (cml::Util::TestRectOverlap({src_origin[0], src_origin[1], src_origin[2]},
+                                       {dst_origin[0], dst_origin[1], dst_origin[2]},
+                                       {region[0], region[1], region[2]}, src_row_pitch, src_slice_pitch)) {
+            return CL_MEM_COPY_OVERLAP;
+        }
+    }
+
+    cmlCommandQueue->EnqueueCopyBufferRect(cmlSrcBuffer, {src_origin[0], src_origin[1], src_origin[2]}, src_row_pitch,
+                                           src_slice_pitch, cmlDstBuffer, {dst_origin[0], dst_origin[1], dst_origin[2]},
+                                           dst_row_pitch, dst_slice_pitch, {region[0], region[1], region[2]});
+
+    if (event) {
+        auto cmlEvent = new cml::Event(cmlCommandQueue);
+        assert(cmlEvent);
+
+        cmlCommandQueue->EnqueueSignalEvent(cmlEvent);
+        event[0] = cmlEvent;
+    }
+
+    return CL_SUCCESS;
 }
 
 cl_int clEnqueueReadImage(cl_command_queue command_queue, cl_mem image, cl_bool blocking_read, const size_t *origin,
@@ -2322,7 +2915,48 @@ cl_int clEnqueueWriteImage(cl_command_queue command_queue, cl_mem image, cl_bool
 cl_int clEnqueueFillImage(cl_command_queue command_queue, cl_mem image, const void *fill_color, const size_t *origin,
                           const size_t *region, cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
                           cl_event *event) {
-    return CL_INVALID_COMMAND_QUEUE;
+    if (!fill_color || !origin || !region) {
+        return CL_INVALID_VALUE;
+    }
+
+    auto cmlCommandQueue = cml::CommandQueue::DownCast(command_queue);
+
+    if (!cmlCommandQueue) {
+        return CL_INVALID_COMMAND_QUEUE;
+    }
+
+    for (auto i = 0; i != num_events_in_wait_list; ++i) {
+        auto cmlEvent = cml::Event::DownCast(event_wait_list[i]);
+
+        if (!cmlEvent) {
+            return CL_INVALID_EVENT;
+        }
+
+        cmlCommandQueue->EnqueueWaitEvent(cmlEvent);
+    }
+
+    auto cmlImage = cml::Image::DownCast(image);
+
+    if (!cmlImage) {
+        return CL_INVALID_MEM_OBJECT;
+    }
+
+    if (!cmlImage->Contains({origin[0], origin[1], origin[2]}, {region[0], region[1], region[2]})) {
+        return CL_INVALID_VALUE;
+    }
+
+    cmlCommandQueue->EnqueueFillImage(fill_color, cmlImage, {origin[0], origin[1], origin[2]},
+                                      {region[0], region[1], region[2]});
+
+    if (event) {
+        auto cmlEvent = new cml::Event(cmlCommandQueue);
+        assert(cmlEvent);
+
+        cmlCommandQueue->EnqueueSignalEvent(cmlEvent);
+        event[0] = cmlEvent;
+    }
+
+    return CL_SUCCESS;
 }
 
 cl_int clEnqueueCopyImage(cl_command_queue command_queue, cl_mem src_image, cl_mem dst_image, const size_t *src_origin,
@@ -2498,33 +3132,173 @@ void *clEnqueueMapBuffer(cl_command_queue command_queue, cl_mem buffer, cl_bool
         return nullptr;
     }
 
-    if (event) {
-        auto cmlEvent = new cml::Event(cmlCommandQueue);
-        assert(cmlEvent);
+    if (cml::Util::TestAnyFlagSet(map_flags, CL_MAP_WRITE_INVALIDATE_REGION) &&
+        cml::Util::TestAnyFlagSet(map_flags, CL_MAP_READ | CL_MAP_WRITE)) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_VALUE;
+        }
 
-        cmlCommandQueue->EnqueueSignalEvent(cmlEvent);
-        event[0] = cmlEvent;
+        return nullptr;
     }
 
-    if (blocking_map) {
-        cmlCommandQueue->Flush();
-        cmlCommandQueue->WaitIdle();
+    if ((cml::Util::TestAnyFlagSet(cmlBuffer->GetFlags(), CL_MEM_HOST_READ_ONLY) &&
+         cml::Util::TestAnyFlagSet(map_flags, CL_MAP_WRITE | CL_MAP_WRITE_INVALIDATE_REGION)) ||
+        (cml::Util::TestAnyFlagSet(cmlBuffer->GetFlags(), CL_MEM_HOST_WRITE_ONLY) &&
+         cml::Util::TestAnyFlagSet(map_flags, CL_MAP_READ))) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_OPERATION;
+        }
+
+        return nullptr;
     }
 
-    auto data = cmlBuffer->Map();
+    if (!size || offset + size > cmlBuffer->GetSize()) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_VALUE;
+        }
+
+        return nullptr;
+    }
+
+    auto data = cmlCommandQueue->EnqueueMapBuffer(cmlBuffer, map_flags, offset, size, blocking_map);
+
+    if (event) {
+        auto cmlEvent = new cml::Event(cmlCommandQueue);
+        assert(cmlEvent);
+
+        cmlCommandQueue->EnqueueSignalEvent(cmlEvent);
+        event[0] = cmlEvent;
+    }
 
     if (errcode_ret) {
-        errcode_ret[0] = data ? CL_SUCCESS : CL_MAP_FAILURE;
+        errcode_ret[0] = CL_SUCCESS;
     }
 
-    return static_cast<uint8_t *>(data) + offset;
+    return data;
 }
 
 void *clEnqueueMapImage(cl_command_queue command_queue, cl_mem image, cl_bool blocking_map, cl_map_flags map_flags,
                         const size_t *origin, const size_t *region, size_t *image_row_pitch, size_t *image_slice_pitch,
                         cl_uint num_events_in_wait_list, const cl_event *event_wait_list, cl_event *event,
                         cl_int *errcode_ret) {
-    return nullptr;
+    if (!origin || !region || !image_row_pitch) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_VALUE;
+        }
+
+        return nullptr;
+    }
+
+    auto cmlCommandQueue = cml::CommandQueue::DownCast(command_queue);
+
+    if (!cmlCommandQueue) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_COMMAND_QUEUE;
+        }
+
+        return nullptr;
+    }
+
+    for (auto i = 0; i != num_events_in_wait_list; ++i) {
+        auto cmlEvent = cml::Event::DownCast(event_wait_list[i]);
+
+        if (!cmlEvent) {
+            if (errcode_ret) {
+                errcode_ret[0] = CL_INVALID_EVENT;
+            }
+
+            return nullptr;
+        }
+
+        cmlCommandQueue->EnqueueWaitEvent(cmlEvent);
+    }
+
+    auto cmlImage = cml::Image::DownCast(image);
+
+    if (!cmlImage) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_MEM_OBJECT;
+        }
+
+        return nullptr;
+    }
+
+    auto type = cmlImage->GetType();
+
+    if (!image_slice_pitch && (type == CL_MEM_OBJECT_IMAGE3D || type == CL_MEM_OBJECT_IMAGE2D_ARRAY ||
+                               type == CL_MEM_OBJECT_IMAGE1D_ARRAY)) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_VALUE;
+        }
+
+        return nullptr;
+    }
+
+    if (!cmlImage->Contains({origin[0], origin[1], origin[2]}, {region[0], region[1], region[2]})) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_VALUE;
+        }
+
+        return nullptr;
+    }
+
+    if (cml::Util::TestAnyFlagSet(map_flags, CL_MAP_WRITE_INVALIDATE_REGION) &&
+        cml::Util::TestAnyFlagSet(map_flags, CL_MAP_READ | CL_MAP_WRITE)) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_VALUE;
+        }
+
+        return nullptr;
+    }
+
+    if ((cml::Util::TestAnyFlagSet(cmlImage->GetFlags(), CL_MEM_HOST_READ_ONLY) &&
+         cml::Util::TestAnyFlagSet(map_flags, CL_MAP_WRITE | CL_MAP_WRITE_INVALIDATE_REGION)) ||
+        (cml::Util::TestAnyFlagSet(cmlImage->GetFlags(), CL_MEM_HOST_WRITE_ONLY) &&
+         cml::Util::TestAnyFlagSet(map_flags, CL_MAP_READ))) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_OPERATION;
+        }
+
+        return nullptr;
+    }
+
+    size_t rowPitch;
+    size_t slicePitch;
+    auto data = cmlCommandQueue->EnqueueMapImage(cmlImage, map_flags, {origin[0], origin[1], origin[2]},
+                                                 {region[0], region[1], region[2]}, rowPitch, slicePitch,
+                                                 blocking_map);
+
+    image_row_pitch[0] = rowPitch;
+
+    // The slices of a 1D image array are its rows, and images without slices report no slice pitch.
+    if (image_slice_pitch) {
+        switch (type) {
+            case CL_MEM_OBJECT_IMAGE3D:
+            case CL_MEM_OBJECT_IMAGE2D_ARRAY:
+                image_slice_pitch[0] = slicePitch;
+                break;
+            case CL_MEM_OBJECT_IMAGE1D_ARRAY:
+                image_slice_pitch[0] = rowPitch;
+                break;
+            default:
+                image_slice_pitch[0] = 0;
+                break;
+        }
+    }
+
+    if (event) {
+        auto cmlEvent = new cml::Event(cmlCommandQueue);
+        assert(cmlEvent);
+
+        cmlCommandQueue->EnqueueSignalEvent(cmlEvent);
+        event[0] = cmlEvent;
+    }
+
+    if (errcode_ret) {
+        errcode_ret[0] = CL_SUCCESS;
+    }
+
+    return data;
 }
 
 cl_int clEnqueueUnmapMemObject(cl_command_queue command_queue, cl_mem memobj, void *mapped_ptr,
@@ -2535,13 +3309,33 @@ cl_int clEnqueueUnmapMemObject(cl_command_queue command_queue, cl_mem memobj, vo
         return CL_INVALID_COMMAND_QUEUE;
     }
 
+    for (auto i = 0; i != num_events_in_wait_list; ++i) {
+        auto cmlEvent = cml::Event::DownCast(event_wait_list[i]);
+
+        if (!cmlEvent) {
+            return CL_INVALID_EVENT;
+        }
+
+        cmlCommandQueue->EnqueueWaitEvent(cmlEvent);
+    }
+
     auto cmlMemory = cml::Memory::DownCast(memobj);
 
     if (!cmlMemory) {
         return CL_INVALID_MEM_OBJECT;
     }
 
-    cmlMemory->Unmap();
+    cml::Mapping mapping{};
+
+    if (!cmlMemory->RemoveMapping(mapped_ptr, mapping)) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (cmlMemory->GetType() == CL_MEM_OBJECT_BUFFER) {
+        cmlCommandQueue->EnqueueUnmapBuffer(cml::Buffer::DownCast(memobj), mapped_ptr, mapping);
+    } else {
+        cmlCommandQueue->EnqueueUnmapImage(cml::Image::DownCast(memobj), mapping);
+    }
 
     if (event) {
         auto cmlEvent = new cml::Event(cmlCommandQueue);
@@ -2670,6 +3464,8 @@ cl_int clEnqueueBarrierWithWaitList(cl_command_queue command_queue, cl_uint num_
         cmlCommandQueue->EnqueueWaitEvent(cmlEvent);
     }
 
+    cmlCommandQueue->EnqueueBarrier();
+
     if (event) {
         auto cmlEvent = new cml::Event(cmlCommandQueue);
         assert(cmlEvent);
@@ -2726,7 +3522,7 @@ cl_int clEnqueueSVMMigrateMem(cl_command_queue command_queue, cl_uint num_svm_po
 #endif
 
 void *clGetExtensionFunctionAddressForPlatform(cl_platform_id platform, const char *func_name) {
-    return nullptr;
+    return func_name ? cml::Dispatch::GetExtensionSymbol(func_name) : nullptr;
 }
 
 cl_int clSetCommandQueueProperty(cl_command_queue command_queue, cl_command_queue_properties properties, cl_bool enable,
@@ -2786,7 +3582,7 @@ cl_mem clCreateImage2D(cl_context context, cl_mem_flags flags, const cl_image_fo
         errcode_ret[0] = CL_SUCCESS;
     }
 
-    return new cml::Image(cmlContext, flags, *image_format, CL_MEM_OBJECT_IMAGE2D, image_width, image_height, 1);
+    return new cml::Image(cmlContext, flags, *image_format, CL_MEM_OBJECT_IMAGE2D, image_width, image_height, 1, 1);
 }
 
 cl_mem clCreateImage3D(cl_context context, cl_mem_flags flags, const cl_image_format *image_format, size_t image_width,
@@ -2839,7 +3635,7 @@ cl_mem clCreateImage3D(cl_context context, cl_mem_flags flags, const cl_image_fo
     }
 
     return new cml::Image(cmlContext, flags, *image_format, CL_MEM_OBJECT_IMAGE3D, image_width, image_height,
-                          image_height);
+                          image_height, 1);
 }
 
 cl_int clEnqueueMarker(cl_command_queue command_queue, cl_event *event) {
@@ -2857,6 +3653,8 @@ cl_int clEnqueueBarrier(cl_command_queue command_queue) {
         return CL_INVALID_COMMAND_QUEUE;
     }
 
+    cmlCommandQueue->EnqueueBarrier();
+
     return CL_SUCCESS;
 }
 
@@ -3079,3 +3877,459 @@ cl_int clGetGLContextInfoKHR(const cl_context_properties *properties, cl_gl_cont
 cl_event clCreateEventFromGLsyncKHR(cl_context context, cl_GLsync sync, cl_int *errcode_ret) {
     return nullptr;
 }
+
+/***********************************************************************************************************************
+* cl_khr_command_buffer extension
+***********************************************************************************************************************/
+
+#ifdef cl_khr_command_buffer
+
+cl_command_buffer_khr clCreateCommandBufferKHR(cl_uint num_queues, const cl_command_queue *queues,
+                                               const cl_command_buffer_properties_khr *properties,
+                                               cl_int *errcode_ret) {
+    if (num_queues != 1 || !queues) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_VALUE;
+        }
+
+        return nullptr;
+    }
+
+    auto cmlCommandQueue = cml::CommandQueue::DownCast(queues[0]);
+
+    if (!cmlCommandQueue) {
+        if (errcode_ret) {
+            errcode_ret[0] = CL_INVALID_COMMAND_QUEUE;
+        }
+
+        return nullptr;
+    }
+
+    auto cmlCommandBuffer = new cml::CommandBuffer(cmlCommandQueue);
+    assert(cmlCommandBuffer);
+
+    if (errcode_ret) {
+        errcode_ret[0] = CL_SUCCESS;
+    }
+
+    return cmlCommandBuffer;
+}
+
+cl_int clFinalizeCommandBufferKHR(cl_command_buffer_khr command_buffer) {
+    auto cmlCommandBuffer = cml::CommandBuffer::DownCast(command_buffer);
+
+    if (!cmlCommandBuffer) {
+        return CL_INVALID_COMMAND_BUFFER_KHR;
+    }
+
+    if (cmlCommandBuffer->GetState() != CL_COMMAND_BUFFER_STATE_RECORDING_KHR) {
+        return CL_INVALID_OPERATION;
+    }
+
+    cmlCommandBuffer->Finalize();
+
+    return CL_SUCCESS;
+}
+
+cl_int clRetainCommandBufferKHR(cl_command_buffer_khr command_buffer) {
+    auto cmlCommandBuffer = cml::CommandBuffer::DownCast(command_buffer);
+
+    if (!cmlCommandBuffer) {
+        return CL_INVALID_COMMAND_BUFFER_KHR;
+    }
+
+    cmlCommandBuffer->Retain();
+
+    return CL_SUCCESS;
+}
+
+cl_int clReleaseCommandBufferKHR(cl_command_buffer_khr command_buffer) {
+    auto cmlCommandBuffer = cml::CommandBuffer::DownCast(command_buffer);
+
+    if (!cmlCommandBuffer) {
+        return CL_INVALID_COMMAND_BUFFER_KHR;
+    }
+
+    if (!cmlCommandBuffer->Release()) {
+        delete cmlCommandBuffer;
+    }
+
+    return CL_SUCCESS;
+}
+
+cl_int clEnqueueCommandBufferKHR(cl_uint num_queues, cl_command_queue *queues, cl_command_buffer_khr command_buffer,
+                                 cl_uint num_events_in_wait_list, const cl_event *event_wait_list, cl_event *event) {
+    auto cmlCommandBuffer = cml::CommandBuffer::DownCast(command_buffer);
+
+    if (!cmlCommandBuffer) {
+        return CL_INVALID_COMMAND_BUFFER_KHR;
+    }
+
+    if (cmlCommandBuffer->GetState() != CL_COMMAND_BUFFER_STATE_EXECUTABLE_KHR) {
+        return CL_INVALID_OPERATION;
+    }
+
+    if ((num_queues && !queues) || (!num_queues && queues) || num_queues > 1) {
+        return CL_INVALID_VALUE;
+    }
+
+    auto cmlCommandQueue = num_queues ? cml::CommandQueue::DownCast(queues[0]) : cmlCommandBuffer->GetCommandQueue();
+
+    if (!cmlCommandQueue) {
+        return CL_INVALID_COMMAND_QUEUE;
+    }
+
+    for (auto i = 0; i != num_events_in_wait_list; ++i) {
+        auto cmlEvent = cml::Event::DownCast(event_wait_list[i]);
+
+        if (!cmlEvent) {
+            return CL_INVALID_EVENT;
+        }
+
+        cmlCommandQueue->EnqueueWaitEvent(cmlEvent);
+    }
+
+    cmlCommandBuffer->Enqueue(cmlCommandQueue);
+
+    if (event) {
+        auto cmlEvent = new cml::Event(cmlCommandQueue);
+        assert(cmlEvent);
+
+        cmlCommandQueue->EnqueueSignalEvent(cmlEvent);
+        event[0] = cmlEvent;
+    }
+
+    return CL_SUCCESS;
+}
+
+cl_int clCommandBarrierWithWaitListKHR(cl_command_buffer_khr command_buffer, cl_command_queue command_queue,
+                                       cl_uint num_sync_points_in_wait_list,
+                                       const cl_sync_point_khr *sync_point_wait_list, cl_sync_point_khr *sync_point,
+                                       cl_mutable_command_khr *mutable_handle) {
+    auto cmlCommandBuffer = cml::CommandBuffer::DownCast(command_buffer);
+
+    if (!cmlCommandBuffer) {
+        return CL_INVALID_COMMAND_BUFFER_KHR;
+    }
+
+    if (command_queue || mutable_handle) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (cmlCommandBuffer->GetState() != CL_COMMAND_BUFFER_STATE_RECORDING_KHR) {
+        return CL_INVALID_OPERATION;
+    }
+
+    if ((num_sync_points_in_wait_list && !sync_point_wait_list) ||
+        (!num_sync_points_in_wait_list && sync_point_wait_list)) {
+        return CL_INVALID_SYNC_POINT_WAIT_LIST_KHR;
+    }
+
+    for (auto i = 0; i != num_sync_points_in_wait_list; ++i) {
+        if (!sync_point_wait_list[i] || sync_point_wait_list[i] > cmlCommandBuffer->GetSyncPointCount()) {
+            return CL_INVALID_SYNC_POINT_WAIT_LIST_KHR;
+        }
+    }
+
+    auto cmlSyncPoint = cmlCommandBuffer->AddBarrier({sync_point_wait_list, num_sync_points_in_wait_list});
+
+    if (sync_point) {
+        sync_point[0] = cmlSyncPoint;
+    }
+
+    return CL_SUCCESS;
+}
+
+cl_int clCommandCopyBufferKHR(cl_command_buffer_khr command_buffer, cl_command_queue command_queue,
+                              cl_mem src_buffer, cl_mem dst_buffer, size_t src_offset, size_t dst_offset, size_t size,
+                              cl_uint num_sync_points_in_wait_list, const cl_sync_point_khr *sync_point_wait_list,
+                              cl_sync_point_khr *sync_point, cl_mutable_command_khr *mutable_handle) {
+    auto cmlCommandBuffer = cml::CommandBuffer::DownCast(command_buffer);
+
+    if (!cmlCommandBuffer) {
+        return CL_INVALID_COMMAND_BUFFER_KHR;
+    }
+
+    if (command_queue || mutable_handle) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (cmlCommandBuffer->GetState() != CL_COMMAND_BUFFER_STATE_RECORDING_KHR) {
+        return CL_INVALID_OPERATION;
+    }
+
+    if ((num_sync_points_in_wait_list && !sync_point_wait_list) ||
+        (!num_sync_points_in_wait_list && sync_point_wait_list)) {
+        return CL_INVALID_SYNC_POINT_WAIT_LIST_KHR;
+    }
+
+    for (auto i = 0; i != num_sync_points_in_wait_list; ++i) {
+        if (!sync_point_wait_list[i] || sync_point_wait_list[i] > cmlCommandBuffer->GetSyncPointCount()) {
+            return CL_INVALID_SYNC_POINT_WAIT_LIST_KHR;
+        }
+    }
+
+    auto cmlSrcBuffer = cml::Buffer::DownCast(src_buffer);
+
+    if (!cmlSrcBuffer) {
+        return CL_INVALID_MEM_OBJECT;
+    }
+
+    auto cmlDstBuffer = cml::Buffer::DownCast(dst_buffer);
+
+    if (!cmlDstBuffer) {
+        return CL_INVALID_MEM_OBJECT;
+    }
+
+    if (!size || src_offset + size > cmlSrcBuffer->GetSize() || dst_offset + size > cmlDstBuffer->GetSize()) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (cmlSrcBuffer == cmlDstBuffer && src_offset < dst_offset + size && dst_offset < src_offset + size) {
+        return CL_MEM_COPY_OVERLAP;
+    }
+
+    auto cmlSyncPoint = cmlCommandBuffer->AddCopyBuffer(cmlSrcBuffer, src_offset, cmlDstBuffer, dst_offset, size,
+                                                        {sync_point_wait_list, num_sync_points_in_wait_list});
+
+    if (sync_point) {
+        sync_point[0] = cmlSyncPoint;
+    }
+
+    return CL_SUCCESS;
+}
+
+cl_int clCommandCopyBufferRectKHR(cl_command_buffer_khr command_buffer, cl_command_queue command_queue,
+                                  cl_mem src_buffer, cl_mem dst_buffer, const size_t *src_origin,
+                                  const size_t *dst_origin, const size_t *region, size_t src_row_pitch,
+                                  size_t src_slice_pitch, size_t dst_row_pitch, size_t dst_slice_pitch,
+                                  cl_uint num_sync_points_in_wait_list, const cl_sync_point_khr *sync_point_wait_list,
+                                  cl_sync_point_khr *sync_point, cl_mutable_command_khr *mutable_handle) {
+    return CL_INVALID_OPERATION;
+}
+
+cl_int clCommandCopyBufferToImageKHR(cl_command_buffer_khr command_buffer, cl_command_queue command_queue,
+                                     cl_mem src_buffer, cl_mem dst_image, size_t src_offset, const size_t *dst_origin,
+                                     const size_t *region, cl_uint num_sync_points_in_wait_list,
+                                     const cl_sync_point_khr *sync_point_wait_list, cl_sync_point_khr *sync_point,
+                                     cl_mutable_command_khr *mutable_handle) {
+    return CL_INVALID_OPERATION;
+}
+
+cl_int clCommandCopyImageKHR(cl_command_buffer_khr command_buffer, cl_command_queue command_queue, cl_mem src_image,
+                             cl_mem dst_image, const size_t *src_origin, const size_t *dst_origin,
+                             const size_t *region, cl_uint num_sync_points_in_wait_list,
+                             const cl_sync_point_khr *sync_point_wait_list, cl_sync_point_khr *sync_point,
+                             cl_mutable_command_khr *mutable_handle) {
+    return CL_INVALID_OPERATION;
+}
+
+cl_int clCommandCopyImageToBufferKHR(cl_command_buffer_khr command_buffer, cl_command_queue command_queue,
+                                     cl_mem src_image, cl_mem dst_buffer, const size_t *src_origin,
+                                     const size_t *region, size_t dst_offset, cl_uint num_sync_points_in_wait_list,
+                                     const cl_sync_point_khr *sync_point_wait_list, cl_sync_point_khr *sync_point,
+                                     cl_mutable_command_khr *mutable_handle) {
+    return CL_INVALID_OPERATION;
+}
+
+cl_int clCommandFillBufferKHR(cl_command_buffer_khr command_buffer, cl_command_queue command_queue, cl_mem buffer,
+                              const void *pattern, size_t pattern_size, size_t offset, size_t size,
+                              cl_uint num_sync_points_in_wait_list, const cl_sync_point_khr *sync_point_wait_list,
+                              cl_sync_point_khr *sync_point, cl_mutable_command_khr *mutable_handle) {
+    auto cmlCommandBuffer = cml::CommandBuffer::DownCast(command_buffer);
+
+    if (!cmlCommandBuffer) {
+        return CL_INVALID_COMMAND_BUFFER_KHR;
+    }
+
+    if (command_queue || mutable_handle) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (!pattern || !std::has_single_bit(pattern_size) || pattern_size > 128 || offset % pattern_size ||
+        size % pattern_size) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (cmlCommandBuffer->GetState() != CL_COMMAND_BUFFER_STATE_RECORDING_KHR) {
+        return CL_INVALID_OPERATION;
+    }
+
+    if ((num_sync_points_in_wait_list && !sync_point_wait_list) ||
+        (!num_sync_points_in_wait_list && sync_point_wait_list)) {
+        return CL_INVALID_SYNC_POINT_WAIT_LIST_KHR;
+    }
+
+    for (auto i = 0; i != num_sync_points_in_wait_list; ++i) {
+        if (!sync_point_wait_list[i] || sync_point_wait_list[i] > cmlCommandBuffer->GetSyncPointCount()) {
+            return CL_INVALID_SYNC_POINT_WAIT_LIST_KHR;
+        }
+    }
+
+    auto cmlBuffer = cml::Buffer::DownCast(buffer);
+
+    if (!cmlBuffer) {
+        return CL_INVALID_MEM_OBJECT;
+    }
+
+    if (offset + size > cmlBuffer->GetSize()) {
+        return CL_INVALID_VALUE;
+    }
+
+    auto cmlSyncPoint = cmlCommandBuffer->AddFillBuffer(pattern, pattern_size, cmlBuffer, offset, size,
+                                                        {sync_point_wait_list, num_sync_points_in_wait_list});
+
+    if (sync_point) {
+        sync_point[0] = cmlSyncPoint;
+    }
+
+    return CL_SUCCESS;
+}
+
+cl_int clCommandFillImageKHR(cl_command_buffer_khr command_buffer, cl_command_queue command_queue, cl_mem image,
+                             const void *fill_color, const size_t *origin, const size_t *region,
+                             cl_uint num_sync_points_in_wait_list, const cl_sync_point_khr *sync_point_wait_list,
+                             cl_sync_point_khr *sync_point, cl_mutable_command_khr *mutable_handle) {
+    return CL_INVALID_OPERATION;
+}
+
+cl_int clCommandNDRangeKernelKHR(cl_command_buffer_khr command_buffer, cl_command_queue command_queue,
+                                 const cl_ndrange_kernel_command_properties_khr *properties, cl_kernel kernel,
+                                 cl_uint work_dim, const size_t *global_work_offset, const size_t *global_work_size,
+                                 const size_t *local_work_size, cl_uint num_sync_points_in_wait_list,
+                                 const cl_sync_point_khr *sync_point_wait_list, cl_sync_point_khr *sync_point,
+                                 cl_mutable_command_khr *mutable_handle) {
+    auto cmlCommandBuffer = cml::CommandBuffer::DownCast(command_buffer);
+
+    if (!cmlCommandBuffer) {
+        return CL_INVALID_COMMAND_BUFFER_KHR;
+    }
+
+    if (command_queue) {
+        return CL_INVALID_VALUE;
+    }
+
+    if (cmlCommandBuffer->GetState() != CL_COMMAND_BUFFER_STATE_RECORDING_KHR) {
+        return CL_INVALID_OPERATION;
+    }
+
+    if (work_dim < 1 || work_dim > 3) {
+        return CL_INVALID_WORK_DIMENSION;
+    }
+
+    if (!global_work_size) {
+        return CL_INVALID_GLOBAL_WORK_SIZE;
+    }
+
+    if (global_work_offset) {
+        return CL_INVALID_GLOBAL_OFFSET;
+    }
+
+    if ((num_sync_points_in_wait_list && !sync_point_wait_list) ||
+        (!num_sync_points_in_wait_list && sync_point_wait_list)) {
+        return CL_INVALID_SYNC_POINT_WAIT_LIST_KHR;
+    }
+
+    for (auto i = 0; i != num_sync_points_in_wait_list; ++i) {
+        if (!sync_point_wait_list[i] || sync_point_wait_list[i] > cmlCommandBuffer->GetSyncPointCount()) {
+            return CL_INVALID_SYNC_POINT_WAIT_LIST_KHR;
+        }
+    }
+
+    auto cmlKernel = cml::Kernel::DownCast(kernel);
+
+    if (!cmlKernel) {
+        return CL_INVALID_KERNEL;
+    }
+
+    cml::Size localWorkSize{0, 0, 0};
+
+    if (local_work_size) {
+        localWorkSize = cml::Util::ConvertToSize(work_dim, local_work_size);
+
+        if (cmlKernel->GetCompileWorkGroupSize() != cml::Size{0, 0, 0} &&
+            cmlKernel->GetCompileWorkGroupSize() != localWorkSize) {
+            return CL_INVALID_WORK_GROUP_SIZE;
+        }
+    }
+
+    auto cmlSyncPoint = cmlCommandBuffer->AddDispatch(cmlKernel, cml::Util::ConvertToSize(work_dim, global_work_size),
+                                                      localWorkSize,
+                                                      {sync_point_wait_list, num_sync_points_in_wait_list});
+
+    if (sync_point) {
+        sync_point[0] = cmlSyncPoint;
+    }
+
+    if (mutable_handle) {
+        mutable_handle[0] = cmlCommandBuffer->GetLastCommand();
+    }
+
+    return CL_SUCCESS;
+}
+
+cl_int clGetCommandBufferInfoKHR(cl_command_buffer_khr command_buffer, cl_command_buffer_info_khr param_name,
+                                 size_t param_value_size, void *param_value, size_t *param_value_size_ret) {
+    auto cmlCommandBuffer = cml::CommandBuffer::DownCast(command_buffer);
+
+    if (!cmlCommandBuffer) {
+        return CL_INVALID_COMMAND_BUFFER_KHR;
+    }
+
+    size_t size;
+    uint8_t info[2048];
+
+    switch (param_name) {
+        case CL_COMMAND_BUFFER_QUEUES_KHR:
+            size = sizeof(cl_command_queue);
+            *((cl_command_queue *) info) = cmlCommandBuffer->GetCommandQueue();
+            break;
+        case CL_COMMAND_BUFFER_NUM_QUEUES_KHR:
+            size = sizeof(cl_uint);
+            *((cl_uint *) info) = 1;
+            break;
+        case CL_COMMAND_BUFFER_REFERENCE_COUNT_KHR:
+            size = sizeof(cl_uint);
+            *((cl_uint *) info) = cmlCommandBuffer->GetReferenceCount();
+            break;
+        case CL_COMMAND_BUFFER_STATE_KHR:
+            size = sizeof(cl_command_buffer_state_khr);
+            *((cl_command_buffer_state_khr *) info) = cmlCommandBuffer->GetState();
+            break;
+        default:
+            return CL_INVALID_VALUE;
+    }
+
+    if (param_value) {
+        if (param_value_size < size) {
+            return CL_INVALID_VALUE;
+        } else {
+            memcpy(param_value, info, size);
+        }
+    }
+
+    if (param_value_size_ret) {
+        param_value_size_ret[0] = size;
+    }
+
+    return CL_SUCCESS;
+}
+
+cl_int clUpdateMutableCommandArgCLMTL(cl_command_buffer_khr command_buffer, cl_mutable_command_khr command,
+                                      cl_uint arg_index, size_t arg_size, const void *arg_value) {
+    auto cmlCommandBuffer = cml::CommandBuffer::DownCast(command_buffer);
+
+    if (!cmlCommandBuffer) {
+        return CL_INVALID_COMMAND_BUFFER_KHR;
+    }
+
+    auto cmlCommand = static_cast<cml::Command *>(command);
+
+    if (!cmlCommand || !cmlCommandBuffer->HasCommand(cmlCommand)) {
+        return CL_INVALID_VALUE;
+    }
+
+    return cmlCommandBuffer->UpdateArg(cmlCommand, arg_index, arg_value, arg_size);
+}
+
+#endif //cl_khr_command_buffer
@@ -0,0 +1,94 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_ENCODER_COALESCER_H
+#define CLMTL_ENCODER_COALESCER_H
+
+#include <cstdint>
+#include <cassert>
+
+namespace cml {
+
+enum class EncoderType {
+    None,
+    Blit,
+    Compute
+};
+
+// Keeps one encoder open across commands of the same type, so only a type switch, a barrier, an event or a flush
+// ends it. Encoders are begun and ended through the traits, which lets the tests record them instead of using Metal.
+template<typename Traits>
+class EncoderCoalescer {
+public:
+    using CommandBuffer = typename Traits::CommandBuffer;
+    using Encoder = typename Traits::Encoder;
+
+public:
+    EncoderCoalescer()
+        : mEncoder{nullptr}, mType{EncoderType::None}, mCount{0} {
+    }
+
+    bool Begin(CommandBuffer *commandBuffer, EncoderType type) {
+        if (mType == type) {
+            return false;
+        }
+
+        End();
+
+        mEncoder = Traits::Begin(commandBuffer, type);
+        assert(mEncoder);
+
+        mType = type;
+        mCount++;
+
+        return true;
+    }
+
+    void End() {
+        if (mType == EncoderType::None) {
+            return;
+        }
+
+        Traits::End(mEncoder);
+        mEncoder = nullptr;
+        mType = EncoderType::None;
+    }
+
+    void ResetCount() {
+        mCount = 0;
+    }
+
+    Encoder *GetEncoder() const {
+        return mEncoder;
+    }
+
+    EncoderType GetType() const {
+        return mType;
+    }
+
+    uint64_t GetCount() const {
+        return mCount;
+    }
+
+private:
+    Encoder *mEncoder;
+    EncoderType mType;
+    uint64_t mCount;
+};
+
+} //namespace cml
+
+#endif //CLMTL_ENCODER_COALESCER_H
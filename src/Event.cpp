@@ -16,6 +16,10 @@
 
 #include "Event.h"
 
+#include <chrono>
+#include <thread>
+#include <vector>
+
 #include "Dispatch.h"
 #include "Context.h"
 #include "Device.h"
@@ -23,30 +27,136 @@
 
 namespace cml {
 
+constexpr auto SpinDuration = std::chrono::microseconds(50);
+constexpr auto MaxPooledCount = 1024;
+
+struct EventPool {
+    std::mutex Mutex;
+    std::vector<void *> Events;
+    std::vector<MTL::SharedEvent *> SharedEvents;
+};
+
+EventPool &GetEventPool() {
+    static EventPool sPool;
+    return sPool;
+}
+
+MTL::SharedEvent *AcquireSharedEvent(MTL::Device *device) {
+    auto &pool = GetEventPool();
+
+    {
+        std::lock_guard lock{pool.Mutex};
+
+        if (!pool.SharedEvents.empty()) {
+            auto sharedEvent = pool.SharedEvents.back();
+
+            pool.SharedEvents.pop_back();
+
+            return sharedEvent;
+        }
+    }
+
+    return device->newSharedEvent();
+}
+
+void RecycleSharedEvent(MTL::SharedEvent *sharedEvent) {
+    auto &pool = GetEventPool();
+
+    {
+        std::lock_guard lock{pool.Mutex};
+
+        if (pool.SharedEvents.size() < MaxPooledCount) {
+            pool.SharedEvents.push_back(sharedEvent);
+            return;
+        }
+    }
+
+    sharedEvent->release();
+}
+
 Event *Event::DownCast(cl_event event) {
     return (Event *) event;
 }
 
+void *Event::operator new(size_t size) {
+    assert(size == sizeof(Event));
+
+    auto &pool = GetEventPool();
+
+    {
+        std::lock_guard lock{pool.Mutex};
+
+        if (!pool.Events.empty()) {
+            auto event = pool.Events.back();
+
+            pool.Events.pop_back();
+
+            return event;
+        }
+    }
+
+    return ::operator new(size);
+}
+
+void Event::operator delete(void *pointer) {
+    auto &pool = GetEventPool();
+
+    {
+        std::lock_guard lock{pool.Mutex};
+
+        if (pool.Events.size() < MaxPooledCount) {
+            pool.Events.push_back(pointer);
+            return;
+        }
+    }
+
+    ::operator delete(pointer);
+}
+
 Event::Event(Context *context)
-    : _cl_event{Dispatch::GetTable()}, Object{}, mContext{context}, mCommandQueue{nullptr}, mStatus{-1}
-    , mEvent{nullptr} {
-    InitEvent();
+    : _cl_event{Dispatch::GetTable()}, Object{}, mContext{context}, mCommandQueue{nullptr}, mProfiling{false}
+    , mStatus{CL_SUBMITTED}, mTimeline{nullptr}, mValue{0}, mProfilingInfo{}, mCallbacks{}, mMutex{}, mCondition{} {
+    InitTimeline();
 }
 
 Event::Event(CommandQueue *commandQueue)
     : _cl_event{Dispatch::GetTable()}, Object{}, mContext{commandQueue->GetContext()}, mCommandQueue{commandQueue}
-    , mStatus{-1}, mEvent{nullptr} {
-    InitEvent();
+    , mProfiling{commandQueue->IsProfiling()}, mStatus{CL_QUEUED}, mTimeline{commandQueue->GetTimeline()->retain()}
+    , mValue{0}, mProfilingInfo{}, mCallbacks{}, mMutex{}, mCondition{} {
 }
 
 Event::~Event() {
-    mEvent->release();
+    // A user event that was never set may still be waited on by the GPU, so only signaled timelines are reused.
+    if (!mCommandQueue && mTimeline->signaledValue() >= mValue) {
+        RecycleSharedEvent(mTimeline);
+    } else {
+        mTimeline->release();
+    }
+}
+
+void Event::Flush() const {
+    if (mCommandQueue && mStatus > CL_COMPLETE) {
+        mCommandQueue->Flush(mValue);
+    }
 }
 
 void Event::WaitComplete() const {
-    if (mStatus != CL_COMPLETE) {
-        mCommandQueue->Flush();
-        mCommandQueue->WaitIdle();
+    Flush();
+
+    // Short commands usually finish within the spin window, which saves a sleep and wake on the condition variable.
+    auto spinEnd = std::chrono::steady_clock::now() + SpinDuration;
+
+    while (mStatus > CL_COMPLETE) {
+        if (std::chrono::steady_clock::now() >= spinEnd) {
+            std::unique_lock lock{mMutex};
+
+            mCondition.wait(lock, [this]() {
+                return mStatus <= CL_COMPLETE;
+            });
+            break;
+        }
+
+        std::this_thread::yield();
     }
 }
 
@@ -55,7 +165,23 @@ void Event::SetStatus(cl_int status) {
         mCallbacks[status](status);
     }
 
+    // Command queues waiting on a user event are released by signaling its timeline, even when it fails.
+    if (!mCommandQueue && status <= CL_COMPLETE) {
+        mTimeline->setSignaledValue(mValue);
+    }
+
+    std::lock_guard lock{mMutex};
+
     mStatus = status;
+    mCondition.notify_all();
+}
+
+void Event::SetValue(uint64_t value) {
+    mValue = value;
+}
+
+void Event::SetProfilingInfo(const ProfilingInfo &profilingInfo) {
+    mProfilingInfo = profilingInfo;
 }
 
 void Event::SetCallback(cl_int type, std::function<void (cl_int)> callback) {
@@ -74,16 +200,30 @@ cl_int Event::GetStatus() const {
     return mStatus;
 }
 
-MTL::Event *Event::GetEvent() const {
-    return mEvent;
+MTL::SharedEvent *Event::GetTimeline() const {
+    return mTimeline;
 }
 
-void Event::InitEvent() {
+uint64_t Event::GetValue() const {
+    return mValue;
+}
+
+ProfilingInfo Event::GetProfilingInfo() const {
+    return mProfilingInfo;
+}
+
+bool Event::IsProfiling() const {
+    return mProfiling;
+}
+
+void Event::InitTimeline() {
     auto device = mContext->GetDevice();
     assert(device);
 
-    mEvent = device->GetDevice()->newEvent();
-    assert(mEvent);
+    mTimeline = AcquireSharedEvent(device->GetDevice());
+    assert(mTimeline);
+
+    mValue = mTimeline->signaledValue() + 1;
 }
 
 } //namespace cml
\ No newline at end of file
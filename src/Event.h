@@ -19,6 +19,9 @@
 
 #include <functional>
 #include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <CL/cl_icd.h>
 
 #include "Metal.hpp"
@@ -33,30 +36,51 @@ namespace cml {
 class Context;
 class CommandQueue;
 
+struct ProfilingInfo {
+    cl_ulong Queued;
+    cl_ulong Submit;
+    cl_ulong Start;
+    cl_ulong End;
+    cl_ulong Complete;
+};
+
 class Event : public _cl_event, public Object {
 public:
     static Event *DownCast(cl_event event);
+    static void *operator new(size_t size);
+    static void operator delete(void *pointer);
 
 public:
     explicit Event(Context *context);
     explicit Event(CommandQueue *commandQueue);
     ~Event() override;
+    void Flush() const;
     void WaitComplete() const;
     void SetStatus(cl_int status);
+    void SetValue(uint64_t value);
+    void SetProfilingInfo(const ProfilingInfo &profilingInfo);
     void SetCallback(cl_int type, std::function<void (cl_int)> callback);
     Context *GetContext() const;
     CommandQueue *GetCommandQueue() const;
     cl_int GetStatus() const;
-    MTL::Event *GetEvent() const;
+    MTL::SharedEvent *GetTimeline() const;
+    uint64_t GetValue() const;
+    ProfilingInfo GetProfilingInfo() const;
+    bool IsProfiling() const;
 
 private:
     Context *mContext;
     CommandQueue *mCommandQueue;
-    cl_int mStatus;
-    MTL::Event *mEvent;
+    bool mProfiling;
+    std::atomic<cl_int> mStatus;
+    MTL::SharedEvent *mTimeline;
+    uint64_t mValue;
+    ProfilingInfo mProfilingInfo;
     std::unordered_map<cl_int, std::function<void (cl_int)>> mCallbacks;
+    mutable std::mutex mMutex;
+    mutable std::condition_variable mCondition;
 
-    void InitEvent();
+    void InitTimeline();
 };
 
 } //namespace cml
@@ -0,0 +1,47 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_EXTENSION_H
+#define CLMTL_EXTENSION_H
+
+#include <CL/cl.h>
+#include <CL/cl_ext.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Queue properties for the automatic flush policy. The thresholds, including the interval in microseconds, are only
+// checked when a command is enqueued, so a lone command still waits for the next enqueue, clFlush or clFinish.
+#define CL_QUEUE_FLUSH_COMMAND_COUNT_CLMTL      0x4F10
+#define CL_QUEUE_FLUSH_BYTE_COUNT_CLMTL         0x4F11
+#define CL_QUEUE_FLUSH_WORK_COUNT_CLMTL         0x4F12
+#define CL_QUEUE_FLUSH_INTERVAL_CLMTL           0x4F13
+#define CL_QUEUE_FLUSH_IDLE_COMMAND_COUNT_CLMTL 0x4F14
+
+#ifdef cl_khr_command_buffer
+
+extern CL_API_ENTRY cl_int CL_API_CALL
+clUpdateMutableCommandArgCLMTL(cl_command_buffer_khr command_buffer, cl_mutable_command_khr command,
+                               cl_uint arg_index, size_t arg_size, const void *arg_value);
+
+#endif
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
+
+#endif //CLMTL_EXTENSION_H
@@ -0,0 +1,143 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include "Hash.h"
+
+#include <cstring>
+
+namespace cml {
+
+// MurmurHash3 x64 128-bit, consumed in 16-byte blocks so the input can arrive in pieces.
+constexpr uint64_t C1 = 0x87c37b91114253d5;
+constexpr uint64_t C2 = 0x4cf5ad432745937f;
+
+uint64_t RotateLeft(uint64_t value, uint32_t shift) {
+    return (value << shift) | (value >> (64 - shift));
+}
+
+uint64_t FinalizeMix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccd;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53;
+    value ^= value >> 33;
+
+    return value;
+}
+
+std::string Hasher::ConvertToString(const Digest &digest) {
+    constexpr auto Digits = "0123456789abcdef";
+    std::string string(32, '0');
+
+    for (auto i = 0; i != 16; ++i) {
+        string[15 - i] = Digits[(digest.High >> (i * 4)) & 0xf];
+        string[31 - i] = Digits[(digest.Low >> (i * 4)) & 0xf];
+    }
+
+    return string;
+}
+
+Hasher::Hasher()
+    : mH1{0}, mH2{0}, mTail{}, mTailSize{0}, mSize{0} {
+}
+
+void Hasher::Update(const void *data, size_t size) {
+    auto bytes = static_cast<const uint8_t *>(data);
+
+    mSize += size;
+
+    if (mTailSize) {
+        auto count = std::min(size, mTail.size() - mTailSize);
+
+        memcpy(mTail.data() + mTailSize, bytes, count);
+        mTailSize += count;
+        bytes += count;
+        size -= count;
+
+        if (mTailSize != mTail.size()) {
+            return;
+        }
+
+        Mix(mTail.data());
+        mTailSize = 0;
+    }
+
+    for (; size >= mTail.size(); bytes += mTail.size(), size -= mTail.size()) {
+        Mix(bytes);
+    }
+
+    memcpy(mTail.data(), bytes, size);
+    mTailSize = size;
+}
+
+void Hasher::Update(const std::string &string) {
+    uint64_t size = string.size();
+
+    Update(&size, sizeof(size));
+    Update(string.data(), string.size());
+}
+
+Digest Hasher::Finalize() const {
+    auto h1 = mH1;
+    auto h2 = mH2;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+
+    for (auto i = mTailSize; i > 8; --i) {
+        k2 ^= uint64_t(mTail[i - 1]) << ((i - 9) * 8);
+    }
+
+    for (auto i = std::min(mTailSize, 8ul); i > 0; --i) {
+        k1 ^= uint64_t(mTail[i - 1]) << ((i - 1) * 8);
+    }
+
+    if (mTailSize > 8) {
+        h2 ^= RotateLeft(k2 * C2, 33) * C1;
+    }
+
+    if (mTailSize) {
+        h1 ^= RotateLeft(k1 * C1, 31) * C2;
+    }
+
+    h1 ^= mSize;
+    h2 ^= mSize;
+    h1 += h2;
+    h2 += h1;
+    h1 = FinalizeMix(h1);
+    h2 = FinalizeMix(h2);
+    h1 += h2;
+    h2 += h1;
+
+    return {h1, h2};
+}
+
+void Hasher::Mix(const uint8_t *block) {
+    uint64_t k1;
+    uint64_t k2;
+
+    memcpy(&k1, block, sizeof(k1));
+    memcpy(&k2, block + sizeof(k1), sizeof(k2));
+
+    mH1 ^= RotateLeft(k1 * C1, 31) * C2;
+    mH1 = RotateLeft(mH1, 27) + mH2;
+    mH1 = mH1 * 5 + 0x52dce729;
+
+    mH2 ^= RotateLeft(k2 * C2, 33) * C1;
+    mH2 = RotateLeft(mH2, 31) + mH1;
+    mH2 = mH2 * 5 + 0x38495ab5;
+}
+
+} //namespace cml
@@ -0,0 +1,69 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_HASH_H
+#define CLMTL_HASH_H
+
+#include <cstdint>
+#include <array>
+#include <string>
+#include <functional>
+
+namespace cml {
+
+struct Digest {
+    uint64_t Low;
+    uint64_t High;
+};
+
+inline bool operator==(const Digest &lhs, const Digest &rhs) {
+    return lhs.Low == rhs.Low && lhs.High == rhs.High;
+}
+
+inline bool operator!=(const Digest &lhs, const Digest &rhs) {
+    return lhs.Low != rhs.Low || lhs.High != rhs.High;
+}
+
+class Hasher {
+public:
+    static std::string ConvertToString(const Digest &digest);
+
+public:
+    Hasher();
+    void Update(const void *data, size_t size);
+    void Update(const std::string &string);
+    Digest Finalize() const;
+
+private:
+    uint64_t mH1;
+    uint64_t mH2;
+    std::array<uint8_t, 16> mTail;
+    size_t mTailSize;
+    uint64_t mSize;
+
+    void Mix(const uint8_t *block);
+};
+
+} //namespace cml
+
+template<>
+struct std::hash<cml::Digest> {
+    size_t operator()(const cml::Digest &digest) const noexcept {
+        return digest.Low ^ digest.High;
+    }
+};
+
+#endif //CLMTL_HASH_H
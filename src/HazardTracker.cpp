@@ -0,0 +1,79 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include "HazardTracker.h"
+
+#include <algorithm>
+
+namespace cml {
+
+bool Contains(const std::vector<const void *> &set, const void *resource) {
+    return std::binary_search(set.begin(), set.end(), resource);
+}
+
+void Insert(std::vector<const void *> &set, const void *resource) {
+    auto iter = std::lower_bound(set.begin(), set.end(), resource);
+
+    if (iter == set.end() || *iter != resource) {
+        set.insert(iter, resource);
+    }
+}
+
+HazardTracker::HazardTracker()
+    : mReads{}, mWrites{}, mEmpty{true} {
+}
+
+bool HazardTracker::HasHazard(std::span<const void *const> reads, std::span<const void *const> writes) const {
+    for (auto read : reads) {
+        if (Contains(mWrites, read)) {
+            return true;
+        }
+    }
+
+    for (auto write : writes) {
+        if (Contains(mReads, write) || Contains(mWrites, write)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void HazardTracker::Add(std::span<const void *const> reads, std::span<const void *const> writes) {
+    // The sets are sorted vectors that keep their capacity across resets, so the enqueue path doesn't allocate once
+    // they have grown to the size of the largest encoder.
+    for (auto read : reads) {
+        Insert(mReads, read);
+    }
+
+    for (auto write : writes) {
+        Insert(mWrites, write);
+    }
+
+    mEmpty = false;
+}
+
+void HazardTracker::Reset() {
+    mReads.clear();
+    mWrites.clear();
+    mEmpty = true;
+}
+
+bool HazardTracker::IsEmpty() const {
+    return mEmpty;
+}
+
+} //namespace cml
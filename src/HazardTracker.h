@@ -0,0 +1,41 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_HAZARD_TRACKER_H
+#define CLMTL_HAZARD_TRACKER_H
+
+#include <vector>
+#include <span>
+
+namespace cml {
+
+class HazardTracker {
+public:
+    HazardTracker();
+    bool HasHazard(std::span<const void *const> reads, std::span<const void *const> writes) const;
+    void Add(std::span<const void *const> reads, std::span<const void *const> writes);
+    void Reset();
+    bool IsEmpty() const;
+
+private:
+    std::vector<const void *> mReads;
+    std::vector<const void *> mWrites;
+    bool mEmpty;
+};
+
+} //namespace cml
+
+#endif //CLMTL_HAZARD_TRACKER_H
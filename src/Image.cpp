@@ -126,8 +126,9 @@ Image *Image::DownCast(cl_mem image) {
 }
 
 Image::Image(Context *context, cl_mem_flags flags, const cl_image_format &format, cl_mem_object_type type,
-             size_t width, size_t height, size_t depth)
-    : Memory{context, flags, type}, mFormat{format}, mWidth{width}, mHeight{height}, mDepth{depth}, mTexture{nullptr} {
+             size_t width, size_t height, size_t depth, size_t arraySize)
+    : Memory{context, flags, type}, mFormat{format}, mWidth{width}, mHeight{height}, mDepth{depth},
+      mArraySize{arraySize}, mTexture{nullptr} {
     InitTexture();
 }
 
@@ -135,13 +136,6 @@ Image::~Image() {
     mTexture->release();
 }
 
-void *Image::Map() {
-    return nullptr;
-}
-
-void Image::Unmap() {
-}
-
 cl_image_format Image::GetFormat() const {
     return mFormat;
 }
@@ -158,6 +152,24 @@ size_t Image::GetDepth() const {
     return mDepth;
 }
 
+size_t Image::GetArraySize() const {
+    return mArraySize;
+}
+
+bool Image::Contains(const Origin &origin, const Size &region) const {
+    Size extent{mWidth, mHeight, mDepth};
+
+    // OpenCL addresses the layers of an image array with the coordinate after its last dimension.
+    if (mType == CL_MEM_OBJECT_IMAGE1D_ARRAY) {
+        extent.h = mArraySize;
+    } else if (mType == CL_MEM_OBJECT_IMAGE2D_ARRAY) {
+        extent.d = mArraySize;
+    }
+
+    return region.w <= extent.w && origin.x <= extent.w - region.w && region.h <= extent.h &&
+           origin.y <= extent.h - region.h && region.d <= extent.d && origin.z <= extent.d - region.d;
+}
+
 MTL::Texture *Image::GetTexture() const {
     return mTexture;
 }
@@ -171,6 +183,7 @@ void Image::InitTexture() {
     descriptor->setWidth(mWidth);
     descriptor->setHeight(mHeight);
     descriptor->setDepth(mDepth);
+    descriptor->setArrayLength(mArraySize);
     descriptor->setResourceOptions(MTL::ResourceStorageModePrivate);
     descriptor->setUsage(ConvertToTextureUsage(mFlags));
 
@@ -28,14 +28,14 @@ public:
 
 public:
     Image(Context *context, cl_mem_flags flags, const cl_image_format &format, cl_mem_object_type type, size_t width,
-          size_t height, size_t depth);
+          size_t height, size_t depth, size_t arraySize);
     ~Image() override;
-    void *Map() override;
-    void Unmap() override;
     cl_image_format GetFormat() const;
     size_t GetWidth() const;
     size_t GetHeight() const;
     size_t GetDepth() const;
+    size_t GetArraySize() const;
+    bool Contains(const Origin &origin, const Size &region) const;
     MTL::Texture *GetTexture() const;
 
 private:
@@ -43,6 +43,7 @@ private:
     size_t mWidth;
     size_t mHeight;
     size_t mDepth;
+    size_t mArraySize;
     MTL::Texture *mTexture;
 
     void InitTexture();
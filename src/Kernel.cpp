@@ -17,6 +17,7 @@
 #include "Kernel.h"
 
 #include <cassert>
+#include <bit>
 #include <sstream>
 
 #include "Dispatch.h"
@@ -26,129 +27,6 @@
 
 namespace cml {
 
-spirv_cross::MSLSamplerCoord ConvertToSamplerCoord(clspv::SamplerNormalizedCoords normalizedCoords) {
-    switch (normalizedCoords) {
-        case clspv::CLK_NORMALIZED_COORDS_FALSE:
-            return spirv_cross::MSL_SAMPLER_COORD_PIXEL;
-        case clspv::CLK_NORMALIZED_COORDS_TRUE:
-        case clspv::CLK_NORMALIZED_COORDS_NOT_SET:
-            return spirv_cross::MSL_SAMPLER_COORD_NORMALIZED;
-        default:
-            throw std::exception();
-    }
-}
-
-spirv_cross::MSLSamplerAddress ConvertToSamplerAddress(clspv::SamplerAddressingMode addressingMode) {
-    switch (addressingMode) {
-        case clspv::CLK_ADDRESS_NONE:
-        case clspv::CLK_ADDRESS_CLAMP_TO_EDGE:
-            return spirv_cross::MSL_SAMPLER_ADDRESS_CLAMP_TO_EDGE;
-        case clspv::CLK_ADDRESS_CLAMP:
-            return spirv_cross::MSL_SAMPLER_ADDRESS_CLAMP_TO_BORDER;
-        case clspv::CLK_ADDRESS_MIRRORED_REPEAT:
-            return spirv_cross::MSL_SAMPLER_ADDRESS_MIRRORED_REPEAT;
-        case clspv::CLK_ADDRESS_REPEAT:
-            return spirv_cross::MSL_SAMPLER_ADDRESS_REPEAT;
-        default:
-            throw std::exception();
-    }
-}
-
-spirv_cross::MSLSamplerFilter ConvertToSamplerFilter(clspv::SamplerFilterMode filterMode) {
-    switch (filterMode) {
-        case clspv::CLK_FILTER_NEAREST:
-            return spirv_cross::MSL_SAMPLER_FILTER_NEAREST;
-        case clspv::CLK_FILTER_LINEAR:
-        case clspv::CLK_FILTER_NOT_SET:
-            return spirv_cross::MSL_SAMPLER_FILTER_LINEAR;
-        default:
-            throw std::exception();
-    }
-}
-
-spirv_cross::MSLConstexprSampler ConvertToConstexprSampler(const LiteralSampler &literalSampler) {
-    spirv_cross::MSLConstexprSampler constexprSampler;
-
-    constexprSampler.coord = ConvertToSamplerCoord(literalSampler.NormalizedCoords);
-    constexprSampler.s_address = ConvertToSamplerAddress(literalSampler.AddressingMode);
-    constexprSampler.r_address = ConvertToSamplerAddress(literalSampler.AddressingMode);
-    constexprSampler.t_address = ConvertToSamplerAddress(literalSampler.AddressingMode);
-    constexprSampler.min_filter = ConvertToSamplerFilter(literalSampler.FilterMode);
-    constexprSampler.mag_filter = ConvertToSamplerFilter(literalSampler.FilterMode);
-
-    return constexprSampler;
-}
-
-void KeepResourceBindings(spirv_cross::CompilerMSL &compiler) {
-    const auto resources = compiler.get_shader_resources();
-    const auto stage = compiler.get_execution_model();
-
-    for (const auto &resource : resources.uniform_buffers) {
-        auto descSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
-        auto binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
-
-        compiler.add_msl_resource_binding({.stage = stage, .desc_set = descSet, .binding = binding,
-                                           .msl_buffer = binding, .msl_texture = binding, .msl_sampler = binding});
-    }
-
-    for (const auto &resource : resources.storage_buffers) {
-        auto descSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
-        auto binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
-
-        compiler.add_msl_resource_binding({.stage = stage, .desc_set = descSet, .binding = binding,
-                                           .msl_buffer = binding, .msl_texture = binding, .msl_sampler = binding});
-    }
-
-    for (const auto &resource : resources.storage_images) {
-        auto descSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
-        auto binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
-
-        compiler.add_msl_resource_binding({.stage = stage, .desc_set = descSet, .binding = binding,
-                                           .msl_buffer = binding, .msl_texture = binding, .msl_sampler = binding});
-    }
-
-    for (auto &resource : resources.sampled_images) {
-        auto descSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
-        auto binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
-
-        compiler.add_msl_resource_binding({.stage = stage, .desc_set = descSet, .binding = binding,
-                                           .msl_buffer = binding, .msl_texture = binding, .msl_sampler = binding});
-    }
-
-    for (auto &resource : resources.separate_images) {
-        auto descSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
-        auto binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
-
-        compiler.add_msl_resource_binding({.stage = stage, .desc_set = descSet, .binding = binding,
-                                           .msl_buffer = binding, .msl_texture = binding, .msl_sampler = binding});
-    }
-
-    for (const auto &resource : resources.separate_samplers) {
-        auto descSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
-        auto binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
-
-        compiler.add_msl_resource_binding({.stage = stage, .desc_set = descSet, .binding = binding,
-                                           .msl_buffer = binding, .msl_texture = binding, .msl_sampler = binding});
-    }
-}
-
-void RemapConstexprSamplers(spirv_cross::CompilerMSL &compiler, const std::vector<LiteralSampler> &literalSamplers) {
-    for (auto &literalSampler : literalSamplers) {
-        compiler.remap_constexpr_sampler_by_binding(literalSampler.DescSet, literalSampler.Binding,
-                                                    ConvertToConstexprSampler(literalSampler));
-    }
-}
-
-std::string ConvertToString(const std::unordered_map<uint32_t, std::string> &defines) {
-    std::stringstream stream;
-
-    for (auto &[ordinal, define] : defines) {
-        stream << define;
-    }
-
-    return stream.str();
-}
-
 uint64_t GetHash(const Size &size) {
     return (size.w << 42) | (size.h << 21) | (size.d << 0);
 }
@@ -186,17 +64,23 @@ Kernel *Kernel::DownCast(cl_kernel kernel) {
 
 Kernel::Kernel(Program *program, const std::string &name)
     : _cl_kernel{Dispatch::GetTable()}, Object{}, mProgram{program}, mReflection{program->GetReflection()}, mName{name}
-    , mPipelineStates{}, mArgTable{} {
+    , mDefaultPipelineState{nullptr}, mPipelineStates{}, mLocalSizes{}, mLocalElementSizes{}, mSpecializedLocalSizes{}
+    , mLocalSizeIds{{{}, 0}}, mLocalSizeId{0}, mArgTable{} {
     InitSource();
     InitPipelineState();
     InitArgTable();
+    mProgram->Retain();
 }
 
 Kernel::~Kernel() {
-    for (auto &[hash, pipelineStates] : mPipelineStates) {
-        for (auto &[defines, pipelineState] : pipelineStates) {
-            pipelineState->release();
-        }
+    mDefaultPipelineState->release();
+
+    mPipelineStates.ForEach([](MTL::ComputePipelineState *pipelineState) {
+        pipelineState->release();
+    });
+
+    if (!mProgram->Release()) {
+        delete mProgram;
     }
 }
 
@@ -208,11 +92,11 @@ void Kernel::SetArg(size_t index, const void *data, size_t size) {
 
         mArgTable[index].Size = size;
     } else {
-        std::stringstream stream;
+        auto &argument = mReflection.Arguments[mName][index];
 
-        stream << "#define SPIRV_CROSS_CONSTANT_ID_" << mReflection.Arguments[mName][index].Spec << " "
-               << size / mReflection.Arguments[mName][index].Size << "\n";
-        mDefines[index] = stream.str();
+        mLocalSizes[argument.Spec] = size / argument.Size;
+        mLocalElementSizes[argument.Spec] = argument.Size;
+        UpdateLocalSizeId();
     }
 }
 
@@ -229,18 +113,21 @@ std::string Kernel::GetName() const {
 }
 
 MTL::ComputePipelineState *Kernel::GetPipelineState(const Size &workGroupSize) {
-    auto hash = GetHash(workGroupSize);
-    auto defines = ConvertToString(mDefines);
-
-    if (!mPipelineStates.count(hash) || !mPipelineStates.at(hash).count(defines)) {
-        AddPipelineState(hash, workGroupSize);
-    }
+    PipelineKey key{.WorkGroupSize = GetHash(workGroupSize), .LocalSizeId = mLocalSizeId};
 
-    return mPipelineStates[hash][defines];
+    return mPipelineStates.At(key, [&]() {
+        return CreatePipelineState(workGroupSize);
+    }, [](MTL::ComputePipelineState *pipelineState) {
+        pipelineState->release();
+    });
 }
 
 size_t Kernel::GetWorkGroupSize() const {
-    return mPipelineStates.at(0).at("")->maxTotalThreadsPerThreadgroup();
+    return mDefaultPipelineState->maxTotalThreadsPerThreadgroup();
+}
+
+Size Kernel::GetDefaultWorkGroupSize() const {
+    return {GetWorkItemExecutionWidth(), GetWorkGroupSize() / GetWorkItemExecutionWidth(), 1};
 }
 
 Size Kernel::GetCompileWorkGroupSize() const {
@@ -252,32 +139,21 @@ Size Kernel::GetCompileWorkGroupSize() const {
 }
 
 size_t Kernel::GetWorkItemExecutionWidth() const {
-    return mPipelineStates.at(0).at("")->threadExecutionWidth();
+    return mDefaultPipelineState->threadExecutionWidth();
 }
 
-std::unordered_map<uint32_t, Arg> Kernel::GetArgTable() const {
+const std::unordered_map<uint32_t, Arg> &Kernel::GetArgTable() const {
     return mArgTable;
 }
 
 void Kernel::InitSource() {
-    spirv_cross::CompilerMSL::Options options;
-
-    options.set_msl_version(2, 3);
-
-    spirv_cross::CompilerMSL compiler(mProgram->GetBinary().data(), mProgram->GetBinary().size());
-
-    compiler.set_msl_options(options);
-    compiler.set_entry_point(mName, spv::ExecutionModelGLCompute);
-    KeepResourceBindings(compiler);
-    RemapConstexprSamplers(compiler, mReflection.LiteralSamplers);
-
-    mSource = compiler.compile();
+    mSource = mProgram->GetShaderSource(mName);
     assert(!mSource.empty());
 }
 
 void Kernel::InitPipelineState() {
     try {
-        AddPipelineState(0, {1, 1, 1});
+        mDefaultPipelineState = CreatePipelineState({1, 1, 1});
     } catch (std::exception &e) {
         Release();
 
@@ -291,15 +167,46 @@ void Kernel::InitArgTable() {
     }
 }
 
+void Kernel::UpdateLocalSizeId() {
+    // Threadgroup arrays need compile time bounds in MSL, so every distinct set of sizes compiles a full library, not
+    // just a specialized function. Rounding up to a power of two only bounds how many libraries a kernel compiles, the
+    // first size of every bucket still pays a full compile. Fall back to the exact sizes when the rounded ones no
+    // longer fit in local memory.
+    uint64_t totalSize = 0;
+
+    for (auto &[spec, size] : mLocalSizes) {
+        mSpecializedLocalSizes[spec] = std::bit_ceil(size);
+        totalSize += mSpecializedLocalSizes[spec] * mLocalElementSizes[spec];
+    }
+
+    if (totalSize > Device::GetSingleton()->GetLimits().LocalMemSize) {
+        mSpecializedLocalSizes = mLocalSizes;
+    }
+
+    // Give every distinct combination of local sizes a small id so the enqueue path never touches the map.
+    mLocalSizeId = mLocalSizeIds.try_emplace(mSpecializedLocalSizes, mLocalSizeIds.size()).first->second;
+}
+
+std::string Kernel::GetDefines() const {
+    std::stringstream stream;
+
+    for (auto &[spec, size] : mSpecializedLocalSizes) {
+        stream << "#define SPIRV_CROSS_CONSTANT_ID_" << spec << " " << size << "\n";
+    }
+
+    return stream.str();
+}
+
 MTL::Function *Kernel::CreateFunction(const Size &workGroupSize) {
     auto name = NS::String::alloc()->init(mName.c_str(), NS::UTF8StringEncoding);
     auto constantValues = CreateConstantValues(workGroupSize, GetDimension(workGroupSize));
     NS::Error *error = nullptr;
 
-    auto function = Device::GetSingleton()->GetLibraryPool()->
-        At(mProgram, ConvertToString(mDefines) + mSource)->newFunction(name, constantValues, &error);
+    auto library = Device::GetSingleton()->GetLibraryPool()->At(mProgram, GetDefines() + mSource);
+    auto function = library->newFunction(name, constantValues, &error);
     assert(function);
 
+    library->release();
     name->release();
     constantValues->release();
 
@@ -310,12 +217,11 @@ MTL::Function *Kernel::CreateFunction(const Size &workGroupSize) {
     return function;
 }
 
-void Kernel::AddPipelineState(uint64_t hash, const Size &workGroupSize) {
+MTL::ComputePipelineState *Kernel::CreatePipelineState(const Size &workGroupSize) {
     auto function = CreateFunction(workGroupSize);
     NS::Error *error = nullptr;
 
-    mPipelineStates[hash][ConvertToString(mDefines)] = Device::GetSingleton()->GetDevice()->
-        newComputePipelineState(function, &error);
+    auto pipelineState = Device::GetSingleton()->GetDevice()->newComputePipelineState(function, &error);
 
     function->release();
 
@@ -324,6 +230,8 @@ void Kernel::AddPipelineState(uint64_t hash, const Size &workGroupSize) {
 
         throw std::exception();
     }
+
+    return pipelineState;
 }
 
 } //namespace cml
@@ -19,12 +19,15 @@
 
 #include <string>
 #include <array>
+#include <map>
+#include <unordered_map>
 #include <CL/cl_icd.h>
 
 #include "Metal.hpp"
 #include "Size.h"
 #include "Object.h"
 #include "Reflector.h"
+#include "PipelineCache.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -69,24 +72,32 @@ public:
     std::string GetName() const;
     MTL::ComputePipelineState *GetPipelineState(const Size &workGroupSize);
     size_t GetWorkGroupSize() const;
+    Size GetDefaultWorkGroupSize() const;
     Size GetCompileWorkGroupSize() const;
     size_t GetWorkItemExecutionWidth() const;
-    std::unordered_map<uint32_t, Arg> GetArgTable() const;
+    const std::unordered_map<uint32_t, Arg> &GetArgTable() const;
 
 private:
     Program *mProgram;
     Reflection mReflection;
     std::string mName;
     std::string mSource;
-    std::unordered_map<uint64_t, std::unordered_map<std::string, MTL::ComputePipelineState *>> mPipelineStates;
-    std::unordered_map<uint32_t, std::string> mDefines;
+    MTL::ComputePipelineState *mDefaultPipelineState;
+    PipelineCache<MTL::ComputePipelineState> mPipelineStates;
+    std::map<uint32_t, uint32_t> mLocalSizes;
+    std::map<uint32_t, uint32_t> mLocalElementSizes;
+    std::map<uint32_t, uint32_t> mSpecializedLocalSizes;
+    std::map<std::map<uint32_t, uint32_t>, uint32_t> mLocalSizeIds;
+    uint32_t mLocalSizeId;
     std::unordered_map<uint32_t, Arg> mArgTable;
 
     void InitSource();
     void InitPipelineState();
     void InitArgTable();
+    void UpdateLocalSizeId();
+    std::string GetDefines() const;
     MTL::Function *CreateFunction(const Size &workGroupSize);
-    void AddPipelineState(uint64_t hash, const Size &workGroupSize);
+    MTL::ComputePipelineState *CreatePipelineState(const Size &workGroupSize);
 };
 
 } //namespace cml
@@ -16,45 +16,162 @@
 
 #include "LibraryPool.h"
 
-#include <sstream>
+#include <cassert>
 
 #include "Device.h"
 #include "Program.h"
+#include "Environment.h"
 
 namespace cml {
 
+constexpr uint64_t DefaultLibraryPoolSize = 64 * 1024 * 1024;
+
+Digest GetLibraryKey(const std::string &source) {
+    Hasher hasher;
+
+    hasher.Update(source.data(), source.size());
+
+    return hasher.Finalize();
+}
+
 LibraryPool::LibraryPool(Device *device)
-    : mDevice{device}, mLibraries{} {
+    : mDevice{device}, mCapacity{Environment::Read("CLMTL_LIBRARY_POOL_SIZE", DefaultLibraryPoolSize)}, mSize{0}
+    , mHitCount{0}, mMissCount{0}, mLibraries{}, mProgramLibraries{}, mRecency{}, mMutex{} {
 }
 
 LibraryPool::~LibraryPool() {
-    for (auto &[program, libraries] : mLibraries) {
-        for (auto &[defines, library] : libraries) {
-            library->release();
+    for (auto &[key, entry] : mLibraries) {
+        entry.Library->release();
+    }
+}
+
+MTL::Library *LibraryPool::At(Program *program, const std::string &source) {
+    auto key = GetLibraryKey(source);
+
+    {
+        std::lock_guard lock{mMutex};
+
+        if (mLibraries.contains(key)) {
+            mHitCount++;
+
+            return AddProgram(key, program);
         }
     }
+
+    // Compiling a library takes long, so it runs without the lock and libraries of different programs compile in
+    // parallel. If another thread added the same library meanwhile, its entry is kept and this one is dropped.
+    auto library = CreateLibrary(source);
+    std::lock_guard lock{mMutex};
+
+    if (mLibraries.contains(key)) {
+        library->release();
+    } else {
+        AddLibrary(key, library, source.size());
+    }
+
+    mMissCount++;
+
+    return AddProgram(key, program);
 }
 
-MTL::Library *LibraryPool::At(Program *program, const std::string &defines) {
-    if (!mLibraries.count(program) || !mLibraries.at(program).count(defines)) {
-        AddLibrary(program, defines);
+void LibraryPool::Release(Program *program) {
+    std::lock_guard lock{mMutex};
+
+    if (!mProgramLibraries.contains(program)) {
+        return;
     }
 
-    return mLibraries[program][defines];
+    auto keys = std::move(mProgramLibraries.at(program));
+
+    mProgramLibraries.erase(program);
+
+    for (auto &key : keys) {
+        auto &entry = mLibraries.at(key);
+
+        entry.Programs.erase(program);
+
+        if (entry.Programs.empty()) {
+            RemoveLibrary(key);
+        }
+    }
 }
 
-void LibraryPool::AddLibrary(Program *program, const std::string &source) {
+uint64_t LibraryPool::GetCapacity() const {
+    return mCapacity;
+}
+
+uint64_t LibraryPool::GetSize() const {
+    std::lock_guard lock{mMutex};
+
+    return mSize;
+}
+
+uint64_t LibraryPool::GetHitCount() const {
+    std::lock_guard lock{mMutex};
+
+    return mHitCount;
+}
+
+uint64_t LibraryPool::GetMissCount() const {
+    std::lock_guard lock{mMutex};
+
+    return mMissCount;
+}
+
+MTL::Library *LibraryPool::CreateLibrary(const std::string &source) {
     auto shader = NS::String::alloc()->init(source.c_str(), NS::UTF8StringEncoding);
-    NS::Error *error;
+    NS::Error *error = nullptr;
 
-    mLibraries[program][source] = mDevice->GetDevice()->newLibrary(shader, nullptr, &error);
-    assert(mLibraries[program][source]);
+    auto library = mDevice->GetDevice()->newLibrary(shader, nullptr, &error);
+    assert(library);
 
     shader->release();
 
     if (error) {
         error->release();
     }
+
+    return library;
+}
+
+void LibraryPool::AddLibrary(const Digest &key, MTL::Library *library, uint64_t size) {
+    mRecency.push_front(key);
+    mLibraries[key] = {.Library = library, .Size = size, .Programs = {}, .Recency = mRecency.begin()};
+    mSize += size;
+}
+
+MTL::Library *LibraryPool::AddProgram(const Digest &key, Program *program) {
+    auto &entry = mLibraries.at(key);
+
+    mRecency.splice(mRecency.begin(), mRecency, entry.Recency);
+    entry.Programs.insert(program);
+    mProgramLibraries[program].insert(key);
+
+    Evict();
+
+    // Other threads may evict or release the library as soon as the lock is dropped, so the caller owns a reference.
+    return entry.Library->retain();
+}
+
+void LibraryPool::RemoveLibrary(const Digest &key) {
+    auto &entry = mLibraries.at(key);
+
+    for (auto program : entry.Programs) {
+        mProgramLibraries.at(program).erase(key);
+    }
+
+    entry.Library->release();
+    mSize -= entry.Size;
+    mRecency.erase(entry.Recency);
+    mLibraries.erase(key);
+}
+
+void LibraryPool::Evict() {
+    while (mSize > mCapacity && mRecency.size() > 1) {
+        auto key = mRecency.back();
+
+        RemoveLibrary(key);
+    }
 }
 
 } //namespace cml
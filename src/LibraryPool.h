@@ -17,28 +17,54 @@
 #ifndef CLMTL_LIBRARY_POOL_H
 #define CLMTL_LIBRARY_POOL_H
 
+#include <cstdint>
+#include <list>
+#include <mutex>
 #include <unordered_map>
-#include <vector>
-#include <spirv_cross/spirv_msl.hpp>
+#include <unordered_set>
 
 #include "Metal.hpp"
+#include "Hash.h"
 
 namespace cml {
 
 class Device;
 class Program;
 
+struct LibraryEntry {
+    MTL::Library *Library;
+    uint64_t Size;
+    std::unordered_set<Program *> Programs;
+    std::list<Digest>::iterator Recency;
+};
+
 class LibraryPool {
 public:
     explicit LibraryPool(Device *device);
     ~LibraryPool();
-    MTL::Library *At(Program *program, const std::string &defines);
+    MTL::Library *At(Program *program, const std::string &source);
+    void Release(Program *program);
+    uint64_t GetCapacity() const;
+    uint64_t GetSize() const;
+    uint64_t GetHitCount() const;
+    uint64_t GetMissCount() const;
 
 private:
     Device *mDevice;
-    std::unordered_map<Program *, std::unordered_map<std::string, MTL::Library *>> mLibraries;
+    uint64_t mCapacity;
+    uint64_t mSize;
+    uint64_t mHitCount;
+    uint64_t mMissCount;
+    std::unordered_map<Digest, LibraryEntry> mLibraries;
+    std::unordered_map<Program *, std::unordered_set<Digest>> mProgramLibraries;
+    std::list<Digest> mRecency;
+    mutable std::mutex mMutex;
 
-    void AddLibrary(Program *program, const std::string &defines);
+    MTL::Library *CreateLibrary(const std::string &source);
+    void AddLibrary(const Digest &key, MTL::Library *library, uint64_t size);
+    MTL::Library *AddProgram(const Digest &key, Program *program);
+    void RemoveLibrary(const Digest &key);
+    void Evict();
 };
 
 } //namespace cml
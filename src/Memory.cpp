@@ -17,6 +17,8 @@
 #include "Memory.h"
 
 #include "Dispatch.h"
+#include "Context.h"
+#include "Device.h"
 
 namespace cml {
 
@@ -25,7 +27,40 @@ Memory *Memory::DownCast(cl_mem memory) {
 }
 
 Memory::Memory(Context *context, cl_mem_flags flags, cl_mem_object_type type)
-    : _cl_mem{Dispatch::GetTable()}, Object{}, mContext{context}, mFlags{flags}, mType{type}, mSize{0}, mMapCount{0} {
+    : _cl_mem{Dispatch::GetTable()}, Object{}, mContext{context}, mFlags{flags}, mType{type}, mSize{0}, mMapCount{0}
+    , mHostPtr{nullptr}, mMappings{}, mMutex{} {
+}
+
+Memory::~Memory() {
+    // Mappings the application never unmapped still own their staging.
+    for (auto &[data, mapping]: mMappings) {
+        if (mapping.Staging) {
+            mapping.Staging->release();
+            mContext->GetDevice()->GetBufferAllocator()->Free(mapping.Allocation);
+        }
+    }
+}
+
+void Memory::AddMapping(void *data, const Mapping &mapping) {
+    std::lock_guard lock{mMutex};
+
+    mMappings.emplace(data, mapping);
+    mMapCount++;
+}
+
+bool Memory::RemoveMapping(void *data, Mapping &mapping) {
+    std::lock_guard lock{mMutex};
+    auto iter = mMappings.find(data);
+
+    if (iter == mMappings.end()) {
+        return false;
+    }
+
+    mapping = iter->second;
+    mMappings.erase(iter);
+    mMapCount--;
+
+    return true;
 }
 
 Context *Memory::GetContext() const {
@@ -48,4 +83,8 @@ cl_uint Memory::GetMapCount() const {
     return mMapCount;
 }
 
+void *Memory::GetHostPtr() const {
+    return mHostPtr;
+}
+
 } //namespace cml
@@ -17,9 +17,15 @@
 #ifndef CLMTL_MEMORY_H
 #define CLMTL_MEMORY_H
 
+#include <mutex>
+#include <unordered_map>
 #include <CL/cl_icd.h>
 
+#include "Metal.hpp"
+#include "Origin.h"
+#include "Size.h"
 #include "Object.h"
+#include "BufferAllocator.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,19 +43,33 @@ namespace cml {
 
 class Context;
 
+struct Mapping {
+    cl_map_flags Flags;
+    size_t Offset;
+    size_t Length;
+    Origin ImageOrigin;
+    Size ImageRegion;
+    size_t RowPitch;
+    size_t SlicePitch;
+    MTL::Buffer *Staging;
+    BufferAllocation Allocation;
+};
+
 class Memory : public _cl_mem, public Object {
 public:
     static Memory *DownCast(cl_mem memory);
 
 public:
     explicit Memory(Context *context, cl_mem_flags flags, cl_mem_object_type type);
-    virtual void *Map() = 0;
-    virtual void Unmap() = 0;
+    ~Memory() override;
+    void AddMapping(void *data, const Mapping &mapping);
+    bool RemoveMapping(void *data, Mapping &mapping);
     Context *GetContext() const;
     cl_mem_flags GetFlags() const;
     cl_mem_object_type GetType() const;
     size_t GetSize() const;
     cl_uint GetMapCount() const;
+    void *GetHostPtr() const;
 
 protected:
     Context *mContext;
@@ -57,6 +77,9 @@ protected:
     cl_mem_object_type mType;
     size_t mSize;
     cl_uint mMapCount;
+    void *mHostPtr;
+    std::unordered_multimap<void *, Mapping> mMappings;
+    std::mutex mMutex;
 };
 
 } //namespace cml
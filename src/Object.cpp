@@ -28,8 +28,10 @@ void Object::Retain() {
     mReferenceCount.fetch_add(1);
 }
 
-void Object::Release() {
-    mReferenceCount.fetch_sub(1);
+uint64_t Object::Release() {
+    // The count is returned rather than read again, as another thread may release the object in between and both
+    // would see it drop to zero.
+    return mReferenceCount.fetch_sub(1) - 1;
 }
 
 uint64_t Object::GetReferenceCount() const {
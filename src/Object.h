@@ -26,7 +26,7 @@ class Object {
 public:
     virtual ~Object();
     void Retain();
-    void Release();
+    uint64_t Release();
     uint64_t GetReferenceCount() const;
 
 protected:
@@ -0,0 +1,96 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_PIPELINE_CACHE_H
+#define CLMTL_PIPELINE_CACHE_H
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace cml {
+
+struct PipelineKey {
+    uint64_t WorkGroupSize;
+    uint32_t LocalSizeId;
+};
+
+inline bool operator==(const PipelineKey &lhs, const PipelineKey &rhs) {
+    return lhs.WorkGroupSize == rhs.WorkGroupSize && lhs.LocalSizeId == rhs.LocalSizeId;
+}
+
+} //namespace cml
+
+template<>
+struct std::hash<cml::PipelineKey> {
+    size_t operator()(const cml::PipelineKey &key) const noexcept {
+        return key.WorkGroupSize ^ (uint64_t(key.LocalSizeId) << 32 | key.LocalSizeId);
+    }
+};
+
+namespace cml {
+
+// Pipelines are created by the factory on the first lookup of a key. Later lookups of the same key don't allocate.
+// Several threads may enqueue the same kernel, so the map is locked, but pipelines are created outside the lock. When
+// two threads create the same pipeline, the first one is kept and the other one is discarded.
+template<typename Pipeline>
+class PipelineCache {
+public:
+    template<typename Factory, typename Discard>
+    Pipeline *At(const PipelineKey &key, Factory &&factory, Discard &&discard) {
+        {
+            std::lock_guard lock{mMutex};
+            auto iter = mPipelines.find(key);
+
+            if (iter != mPipelines.end()) {
+                return iter->second;
+            }
+        }
+
+        auto pipeline = factory();
+        std::lock_guard lock{mMutex};
+        auto [iter, inserted] = mPipelines.emplace(key, pipeline);
+
+        if (!inserted) {
+            discard(pipeline);
+        }
+
+        return iter->second;
+    }
+
+    template<typename Function>
+    void ForEach(Function &&function) const {
+        std::lock_guard lock{mMutex};
+
+        for (auto &[key, pipeline] : mPipelines) {
+            function(pipeline);
+        }
+    }
+
+    size_t GetSize() const {
+        std::lock_guard lock{mMutex};
+
+        return mPipelines.size();
+    }
+
+private:
+    std::unordered_map<PipelineKey, Pipeline *> mPipelines;
+    mutable std::mutex mMutex;
+};
+
+} //namespace cml
+
+#endif //CLMTL_PIPELINE_CACHE_H
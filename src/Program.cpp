@@ -16,22 +16,120 @@
 
 #include "Program.h"
 
+#include <cstdlib>
+#include <sstream>
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <filesystem>
 #include <clspv/Compiler.h>
 #include <spirv-tools/linker.hpp>
 
 #include "Dispatch.h"
+#include "Translator.h"
+#include "Hash.h"
+#include "DiskCache.h"
+#include "Context.h"
+#include "Device.h"
+#include "LibraryPool.h"
 
 namespace cml {
 
 constexpr auto DefaultOptions = "--cluster-pod-kernel-args=0";
+constexpr auto CompilerVersion = CLMTL_COMPILER_VERSION;
+constexpr auto LinkerVersion = CLMTL_LINKER_VERSION;
+constexpr uint32_t SpirvMagic = 0x07230203;
+
+std::string NormalizeOptions(const std::string &options) {
+    std::stringstream stream(options);
+    std::string normalizedOptions;
+
+    for (std::string option; stream >> option;) {
+        normalizedOptions += option + " ";
+    }
+
+    return normalizedOptions;
+}
+
+std::mutex &GetInFlightMutex() {
+    static std::mutex sMutex;
+    return sMutex;
+}
+
+std::unordered_map<Digest, std::shared_future<CompileResult>> &GetInFlightCompiles() {
+    static std::unordered_map<Digest, std::shared_future<CompileResult>> sCompiles;
+    return sCompiles;
+}
+
+std::vector<uint8_t> Serialize(const std::vector<uint32_t> &binary, const std::string &log) {
+    uint64_t size = binary.size() * sizeof(uint32_t);
+    std::vector<uint8_t> data(sizeof(size) + size + log.size());
+
+    memcpy(data.data(), &size, sizeof(size));
+    memcpy(data.data() + sizeof(size), binary.data(), size);
+    memcpy(data.data() + sizeof(size) + size, log.data(), log.size());
+
+    return data;
+}
+
+bool Deserialize(const std::vector<uint8_t> &data, std::vector<uint32_t> &binary, std::string &log) {
+    uint64_t size;
+
+    if (data.size() < sizeof(size)) {
+        return false;
+    }
+
+    memcpy(&size, data.data(), sizeof(size));
+
+    if (!size || size % sizeof(uint32_t) || size > data.size() - sizeof(size)) {
+        return false;
+    }
+
+    binary.resize(size / sizeof(uint32_t));
+    memcpy(binary.data(), data.data() + sizeof(size), size);
+    log.assign(data.begin() + sizeof(size) + size, data.end());
+
+    return binary[0] == SpirvMagic;
+}
+
+Digest GetLinkKey(const std::string &options, const std::vector<std::vector<uint32_t>> &binaries) {
+    Hasher hasher;
+
+    hasher.Update(LinkerVersion);
+    hasher.Update(NormalizeOptions(options));
+
+    for (auto &binary : binaries) {
+        uint64_t size = binary.size() * sizeof(uint32_t);
+
+        hasher.Update(&size, sizeof(size));
+        hasher.Update(binary.data(), size);
+    }
+
+    return hasher.Finalize();
+}
 
 Program *Program::DownCast(cl_program program) {
     return (Program *) program;
 }
 
+bool Program::IsValidHeaderName(const std::string &name) {
+    std::filesystem::path path{name};
+
+    // Headers are written below a private directory, so names must not be able to point outside of it.
+    return !path.empty() && path.is_relative() && !path.has_root_name() &&
+           std::none_of(path.begin(), path.end(), [](const std::filesystem::path &component) {
+               return component == "..";
+           });
+}
+
 Program::Program(Context *context) :
     _cl_program{Dispatch::GetTable()}, Object{}, mContext{context}, mSource{}, mOptions{DefaultOptions},
-    mBinary{}, mLog{}, mBuildStatus{CL_BUILD_NONE} {
+    mBinary{}, mLog{}, mBuildStatus{CL_BUILD_NONE}, mBuilding{false}, mBinaryType{CL_PROGRAM_BINARY_TYPE_NONE},
+    mMutex{}, mCondition{} {
+}
+
+Program::~Program() {
+    mContext->GetDevice()->GetLibraryPool()->Release(this);
 }
 
 void Program::AddSource(const std::string &source) {
@@ -39,18 +137,96 @@ void Program::AddSource(const std::string &source) {
 }
 
 void Program::Compile() {
-    if (!mBinary.empty() || !clspv::CompileFromSourceString(mSource, "", mOptions, &mBinary, &mLog)) {
+    if (mSource.empty() && !mBinary.empty()) {
         mBuildStatus = CL_BUILD_SUCCESS;
-    } else {
-        mBuildStatus = CL_BUILD_ERROR;
+        return;
+    }
+
+    auto compileCache = mContext->GetDevice()->GetCompileCache();
+    auto key = GetCompileKey();
+    std::vector<uint8_t> data;
+
+    if (compileCache->Load(key, data) && Deserialize(data, mBinary, mLog)) {
+        mBuildStatus = CL_BUILD_SUCCESS;
+        mBinaryType = CL_PROGRAM_BINARY_TYPE_COMPILED_OBJECT;
+        return;
+    }
+
+    std::promise<CompileResult> promise;
+    std::shared_future<CompileResult> future;
+    bool owner = false;
+
+    {
+        std::lock_guard lock{GetInFlightMutex()};
+        auto &compiles = GetInFlightCompiles();
+
+        if (compiles.contains(key)) {
+            future = compiles.at(key);
+        } else {
+            future = promise.get_future().share();
+            compiles[key] = future;
+            owner = true;
+        }
+    }
+
+    // Identical builds running at the same time wait for the first one instead of invoking clspv again.
+    if (owner) {
+        CompileResult result{};
+
+        // Waiters of the same build would block forever if the promise was left unset.
+        try {
+            result = CompileSource();
+        } catch (std::exception &e) {
+            result.Log = e.what();
+        }
+
+        if (result.Success) {
+            compileCache->Store(key, Serialize(result.Binary, result.Log));
+        }
+
+        promise.set_value(std::move(result));
+
+        std::lock_guard lock{GetInFlightMutex()};
+        GetInFlightCompiles().erase(key);
+    }
+
+    auto &result = future.get();
+
+    mBinary = result.Binary;
+    mLog = result.Log;
+    mBuildStatus = result.Success ? CL_BUILD_SUCCESS : CL_BUILD_ERROR;
+
+    if (result.Success) {
+        mBinaryType = CL_PROGRAM_BINARY_TYPE_COMPILED_OBJECT;
     }
 }
 
 void Program::Link(const std::vector<std::vector<uint32_t>> &binaries) {
+    auto compileCache = mContext->GetDevice()->GetCompileCache();
+    auto key = GetLinkKey(mOptions, binaries);
+    std::vector<uint8_t> data;
+
+    if (compileCache->Load(key, data) && Deserialize(data, mBinary, mLog)) {
+        mBuildStatus = CL_BUILD_SUCCESS;
+        mBinaryType = CL_PROGRAM_BINARY_TYPE_EXECUTABLE;
+        return;
+    }
+
     auto spvContext = spvtools::Context(SPV_ENV_OPENCL_1_2);
 
+    mBinary.clear();
+    mLog.clear();
+
+    spvContext.SetMessageConsumer([this](spv_message_level_t, const char *, const spv_position_t &,
+                                         const char *message) {
+        mLog += message;
+        mLog += "\n";
+    });
+
     if (!spvtools::Link(spvContext, binaries, &mBinary)) {
+        compileCache->Store(key, Serialize(mBinary, mLog));
         mBuildStatus = CL_BUILD_SUCCESS;
+        mBinaryType = CL_PROGRAM_BINARY_TYPE_EXECUTABLE;
     } else {
         mBuildStatus = CL_BUILD_ERROR;
     }
@@ -60,10 +236,62 @@ void Program::Reflect() {
     mReflection = Reflector::Reflect(mBinary);
 }
 
+void Program::Translate() {
+    mShaderSources = Translator::Translate(mBinary, mReflection, mContext->GetDevice()->GetTranslationCache());
+}
+
+void Program::Build() {
+    Compile();
+
+    if (mBuildStatus == CL_BUILD_SUCCESS) {
+        try {
+            Reflect();
+            Translate();
+            mBinaryType = CL_PROGRAM_BINARY_TYPE_EXECUTABLE;
+        } catch (std::exception &e) {
+            mBuildStatus = CL_BUILD_ERROR;
+        }
+    }
+
+    EndBuild();
+}
+
+bool Program::BeginBuild() {
+    std::lock_guard lock{mMutex};
+
+    // Testing and setting under one lock makes sure only one of several concurrent builds starts.
+    if (mBuilding) {
+        return false;
+    }
+
+    mBuilding = true;
+
+    return true;
+}
+
+void Program::EndBuild() {
+    std::lock_guard lock{mMutex};
+
+    mBuilding = false;
+    mCondition.notify_all();
+}
+
+void Program::WaitBuild() {
+    std::unique_lock lock{mMutex};
+
+    mCondition.wait(lock, [this]() {
+        return !mBuilding;
+    });
+}
+
 void Program::SetOptions(const std::string &options) {
     mOptions = options + " " + DefaultOptions;
 }
 
+void Program::SetHeaders(const std::map<std::string, std::string> &headers) {
+    mHeaders = headers;
+}
+
 void Program::SetBinary(const std::vector<uint32_t> &binary) {
     mBinary = binary;
 }
@@ -81,11 +309,19 @@ std::string Program::GetOptions() const {
 }
 
 cl_build_status Program::GetBuildStatus() const {
-    return mBuildStatus;
+    std::lock_guard lock{mMutex};
+
+    return mBuilding ? CL_BUILD_IN_PROGRESS : mBuildStatus.load();
+}
+
+cl_program_binary_type Program::GetBinaryType() const {
+    return mBinaryType;
 }
 
 std::string Program::GetLog() const {
-    return mLog;
+    std::lock_guard lock{mMutex};
+
+    return mBuilding ? std::string{} : mLog;
 }
 
 std::span<const uint32_t> Program::GetBinary() const {
@@ -96,4 +332,70 @@ Reflection Program::GetReflection() const {
     return mReflection;
 }
 
+std::string Program::GetShaderSource(const std::string &name) const {
+    return mShaderSources.count(name) ? mShaderSources.at(name) : std::string{};
+}
+
+Digest Program::GetCompileKey() const {
+    Hasher hasher;
+
+    hasher.Update(CompilerVersion);
+    hasher.Update(NormalizeOptions(mOptions));
+    hasher.Update(mSource);
+
+    for (auto &[name, source] : mHeaders) {
+        hasher.Update(name);
+        hasher.Update(source);
+    }
+
+    return hasher.Finalize();
+}
+
+CompileResult Program::CompileSource() const {
+    CompileResult result{};
+
+    if (mHeaders.empty()) {
+        result.Success = !clspv::CompileFromSourceString(mSource, "", mOptions, &result.Binary, &result.Log);
+        return result;
+    }
+
+    // clspv only resolves includes through the file system, so embedded headers are written to a private directory.
+    // It is unique per compile, because identical compiles in other processes would remove it while it's in use.
+    std::error_code error;
+    auto pattern = (std::filesystem::temp_directory_path(error) / "clmtl-XXXXXX").string();
+
+    if (error || !mkdtemp(pattern.data())) {
+        result.Log = "failed to create header directory\n";
+        return result;
+    }
+
+    std::filesystem::path directory{pattern};
+
+    for (auto &[name, source] : mHeaders) {
+        if (!IsValidHeaderName(name)) {
+            result.Log = "invalid header name: " + name + "\n";
+            break;
+        }
+
+        auto path = directory / name;
+
+        std::filesystem::create_directories(path.parent_path(), error);
+
+        if (error || !(std::ofstream{path, std::ios::binary} << source)) {
+            result.Log = "failed to write header: " + name + "\n";
+            break;
+        }
+    }
+
+    if (result.Log.empty()) {
+        auto options = mOptions + " -I" + directory.string();
+
+        result.Success = !clspv::CompileFromSourceString(mSource, "", options, &result.Binary, &result.Log);
+    }
+
+    std::filesystem::remove_all(directory, error);
+
+    return result;
+}
+
 } //namespace cml
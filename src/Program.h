@@ -20,9 +20,15 @@
 #include <vector>
 #include <string>
 #include <span>
+#include <map>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <CL/cl_icd.h>
 
 #include "Object.h"
+#include "Hash.h"
 #include "Reflector.h"
 
 #ifdef __cplusplus
@@ -41,34 +47,59 @@ namespace cml {
 
 class Context;
 
+struct CompileResult {
+    std::vector<uint32_t> Binary;
+    std::string Log;
+    bool Success;
+};
+
 class Program : public _cl_program, public Object {
 public:
     static Program *DownCast(cl_program program);
+    static bool IsValidHeaderName(const std::string &name);
 
 public:
     explicit Program(Context *context);
+    ~Program() override;
     void AddSource(const std::string &source);
     void Compile();
     void Link(const std::vector<std::vector<uint32_t>> &binaries);
     void Reflect();
+    void Translate();
+    void Build();
+    bool BeginBuild();
+    void EndBuild();
+    void WaitBuild();
     void SetOptions(const std::string &options);
+    void SetHeaders(const std::map<std::string, std::string> &headers);
     void SetBinary(const std::vector<uint32_t> &binary);
     Context *GetContext() const;
     std::string GetSource() const;
     std::string GetOptions() const;
     cl_build_status GetBuildStatus() const;
+    cl_program_binary_type GetBinaryType() const;
     std::string GetLog() const;
     std::span<const uint32_t> GetBinary() const;
     Reflection GetReflection() const;
+    std::string GetShaderSource(const std::string &name) const;
 
 private:
     Context *mContext;
     std::string mSource;
     std::string mOptions;
+    std::map<std::string, std::string> mHeaders;
     std::vector<uint32_t> mBinary;
-    cl_build_status mBuildStatus;
+    std::atomic<cl_build_status> mBuildStatus;
+    bool mBuilding;
+    cl_program_binary_type mBinaryType;
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
     std::string mLog;
     Reflection mReflection;
+    std::unordered_map<std::string, std::string> mShaderSources;
+
+    Digest GetCompileKey() const;
+    CompileResult CompileSource() const;
 };
 
 } //namespace cml
@@ -158,6 +158,7 @@ private:
 
     void ParseKernel(const spv_parsed_instruction_t *inst) {
         mStrings[inst->result_id] = mStrings[inst->words[inst->operands[5].offset]];
+        mReflection.Arguments[mStrings[inst->result_id]];
     }
 
     void ParseArgumentInfo(const spv_parsed_instruction_t *inst) {
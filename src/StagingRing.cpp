@@ -0,0 +1,93 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include "StagingRing.h"
+
+#include <cassert>
+#include <algorithm>
+
+namespace cml {
+
+constexpr size_t StagingAlignment = 256;
+
+size_t AlignUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+StagingRing::StagingRing(MTL::Device *device, size_t capacity)
+    : mBuffer{nullptr}, mCapacity{AlignUp(capacity, StagingAlignment)}, mHead{0}, mUsedSize{0}, mBlocks{} {
+    InitBuffer(device);
+}
+
+StagingRing::~StagingRing() {
+    mBuffer->release();
+}
+
+bool StagingRing::Allocate(size_t size, uint64_t serial, StagingAllocation &allocation) {
+    size = AlignUp(std::max(size, size_t{1}), StagingAlignment);
+
+    auto offset = mHead;
+    size_t padding = 0;
+
+    // An allocation never wraps around, so the space left at the end is skipped and reclaimed with this block.
+    if (offset + size > mCapacity) {
+        padding = mCapacity - offset;
+        offset = 0;
+    }
+
+    if (padding + size > mCapacity - mUsedSize) {
+        return false;
+    }
+
+    if (!mBlocks.empty() && mBlocks.back().Serial == serial) {
+        mBlocks.back().Size += padding + size;
+    } else {
+        mBlocks.push_back({serial, padding + size});
+    }
+
+    mHead = (offset + size) % mCapacity;
+    mUsedSize += padding + size;
+    allocation = {mBuffer, offset, static_cast<uint8_t *>(mBuffer->contents()) + offset};
+
+    return true;
+}
+
+void StagingRing::Reclaim(uint64_t serial) {
+    while (!mBlocks.empty() && mBlocks.front().Serial <= serial) {
+        mUsedSize -= mBlocks.front().Size;
+        mBlocks.pop_front();
+    }
+
+    if (mBlocks.empty()) {
+        mHead = 0;
+    }
+}
+
+size_t StagingRing::GetCapacity() const {
+    return mCapacity;
+}
+
+size_t StagingRing::GetUsedSize() const {
+    return mUsedSize;
+}
+
+void StagingRing::InitBuffer(MTL::Device *device) {
+    // Reuse is ordered by command buffer completion, so Metal doesn't need to track hazards on the ring.
+    mBuffer = device->newBuffer(mCapacity, MTL::ResourceStorageModeShared | MTL::ResourceHazardTrackingModeUntracked);
+    assert(mBuffer);
+}
+
+} //namespace cml
@@ -0,0 +1,58 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_STAGING_RING_H
+#define CLMTL_STAGING_RING_H
+
+#include <deque>
+
+#include "Metal.hpp"
+
+namespace cml {
+
+struct StagingAllocation {
+    MTL::Buffer *Buffer;
+    size_t Offset;
+    uint8_t *Data;
+};
+
+class StagingRing {
+public:
+    StagingRing(MTL::Device *device, size_t capacity);
+    ~StagingRing();
+    bool Allocate(size_t size, uint64_t serial, StagingAllocation &allocation);
+    void Reclaim(uint64_t serial);
+    size_t GetCapacity() const;
+    size_t GetUsedSize() const;
+
+private:
+    struct Block {
+        uint64_t Serial;
+        size_t Size;
+    };
+
+    MTL::Buffer *mBuffer;
+    size_t mCapacity;
+    size_t mHead;
+    size_t mUsedSize;
+    std::deque<Block> mBlocks;
+
+    void InitBuffer(MTL::Device *device);
+};
+
+} //namespace cml
+
+#endif //CLMTL_STAGING_RING_H
@@ -0,0 +1,211 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include "Translator.h"
+
+#include <memory>
+#include <spirv_cross/spirv_parser.hpp>
+#include <spirv_cross/spirv_msl.hpp>
+
+#include "Hash.h"
+#include "DiskCache.h"
+
+namespace cml {
+
+constexpr auto TranslatorVersion = CLMTL_TRANSLATOR_VERSION;
+constexpr auto TranslatorOptions = "keep-resource-bindings remap-constexpr-samplers";
+constexpr uint32_t MslMajorVersion = 2;
+constexpr uint32_t MslMinorVersion = 3;
+
+spirv_cross::MSLSamplerCoord ConvertToSamplerCoord(clspv::SamplerNormalizedCoords normalizedCoords) {
+    switch (normalizedCoords) {
+        case clspv::CLK_NORMALIZED_COORDS_FALSE:
+            return spirv_cross::MSL_SAMPLER_COORD_PIXEL;
+        case clspv::CLK_NORMALIZED_COORDS_TRUE:
+        case clspv::CLK_NORMALIZED_COORDS_NOT_SET:
+            return spirv_cross::MSL_SAMPLER_COORD_NORMALIZED;
+        default:
+            throw std::exception();
+    }
+}
+
+spirv_cross::MSLSamplerAddress ConvertToSamplerAddress(clspv::SamplerAddressingMode addressingMode) {
+    switch (addressingMode) {
+        case clspv::CLK_ADDRESS_NONE:
+        case clspv::CLK_ADDRESS_CLAMP_TO_EDGE:
+            return spirv_cross::MSL_SAMPLER_ADDRESS_CLAMP_TO_EDGE;
+        case clspv::CLK_ADDRESS_CLAMP:
+            return spirv_cross::MSL_SAMPLER_ADDRESS_CLAMP_TO_BORDER;
+        case clspv::CLK_ADDRESS_MIRRORED_REPEAT:
+            return spirv_cross::MSL_SAMPLER_ADDRESS_MIRRORED_REPEAT;
+        case clspv::CLK_ADDRESS_REPEAT:
+            return spirv_cross::MSL_SAMPLER_ADDRESS_REPEAT;
+        default:
+            throw std::exception();
+    }
+}
+
+spirv_cross::MSLSamplerFilter ConvertToSamplerFilter(clspv::SamplerFilterMode filterMode) {
+    switch (filterMode) {
+        case clspv::CLK_FILTER_NEAREST:
+            return spirv_cross::MSL_SAMPLER_FILTER_NEAREST;
+        case clspv::CLK_FILTER_LINEAR:
+        case clspv::CLK_FILTER_NOT_SET:
+            return spirv_cross::MSL_SAMPLER_FILTER_LINEAR;
+        default:
+            throw std::exception();
+    }
+}
+
+spirv_cross::MSLConstexprSampler ConvertToConstexprSampler(const LiteralSampler &literalSampler) {
+    spirv_cross::MSLConstexprSampler constexprSampler;
+
+    constexprSampler.coord = ConvertToSamplerCoord(literalSampler.NormalizedCoords);
+    constexprSampler.s_address = ConvertToSamplerAddress(literalSampler.AddressingMode);
+    constexprSampler.r_address = ConvertToSamplerAddress(literalSampler.AddressingMode);
+    constexprSampler.t_address = ConvertToSamplerAddress(literalSampler.AddressingMode);
+    constexprSampler.min_filter = ConvertToSamplerFilter(literalSampler.FilterMode);
+    constexprSampler.mag_filter = ConvertToSamplerFilter(literalSampler.FilterMode);
+
+    return constexprSampler;
+}
+
+void KeepResourceBindings(spirv_cross::CompilerMSL &compiler) {
+    const auto resources = compiler.get_shader_resources();
+    const auto stage = compiler.get_execution_model();
+
+    for (const auto &resource : resources.uniform_buffers) {
+        auto descSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+        auto binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
+
+        compiler.add_msl_resource_binding({.stage = stage, .desc_set = descSet, .binding = binding,
+                                           .msl_buffer = binding, .msl_texture = binding, .msl_sampler = binding});
+    }
+
+    for (const auto &resource : resources.storage_buffers) {
+        auto descSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+        auto binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
+
+        compiler.add_msl_resource_binding({.stage = stage, .desc_set = descSet, .binding = binding,
+                                           .msl_buffer = binding, .msl_texture = binding, .msl_sampler = binding});
+    }
+
+    for (const auto &resource : resources.storage_images) {
+        auto descSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+        auto binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
+
+        compiler.add_msl_resource_binding({.stage = stage, .desc_set = descSet, .binding = binding,
+                                           .msl_buffer = binding, .msl_texture = binding, .msl_sampler = binding});
+    }
+
+    for (auto &resource : resources.sampled_images) {
+        auto descSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+        auto binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
+
+        compiler.add_msl_resource_binding({.stage = stage, .desc_set = descSet, .binding = binding,
+                                           .msl_buffer = binding, .msl_texture = binding, .msl_sampler = binding});
+    }
+
+    for (auto &resource : resources.separate_images) {
+        auto descSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+        auto binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
+
+        compiler.add_msl_resource_binding({.stage = stage, .desc_set = descSet, .binding = binding,
+                                           .msl_buffer = binding, .msl_texture = binding, .msl_sampler = binding});
+    }
+
+    for (const auto &resource : resources.separate_samplers) {
+        auto descSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+        auto binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
+
+        compiler.add_msl_resource_binding({.stage = stage, .desc_set = descSet, .binding = binding,
+                                           .msl_buffer = binding, .msl_texture = binding, .msl_sampler = binding});
+    }
+}
+
+void RemapConstexprSamplers(spirv_cross::CompilerMSL &compiler, const std::vector<LiteralSampler> &literalSamplers) {
+    for (auto &literalSampler : literalSamplers) {
+        compiler.remap_constexpr_sampler_by_binding(literalSampler.DescSet, literalSampler.Binding,
+                                                    ConvertToConstexprSampler(literalSampler));
+    }
+}
+
+std::string TranslateEntryPoint(const spirv_cross::ParsedIR &ir, const std::string &name,
+                                const std::vector<LiteralSampler> &literalSamplers) {
+    spirv_cross::CompilerMSL::Options options;
+
+    options.set_msl_version(MslMajorVersion, MslMinorVersion);
+
+    spirv_cross::CompilerMSL compiler(ir);
+
+    compiler.set_msl_options(options);
+    compiler.set_entry_point(name, spv::ExecutionModelGLCompute);
+    KeepResourceBindings(compiler);
+    RemapConstexprSamplers(compiler, literalSamplers);
+
+    return compiler.compile();
+}
+
+Digest GetTranslationKey(const Digest &binaryDigest, const std::string &name) {
+    Hasher hasher;
+
+    hasher.Update(TranslatorVersion);
+    hasher.Update(TranslatorOptions);
+    hasher.Update(&MslMajorVersion, sizeof(MslMajorVersion));
+    hasher.Update(&MslMinorVersion, sizeof(MslMinorVersion));
+    hasher.Update(&binaryDigest, sizeof(binaryDigest));
+    hasher.Update(name);
+
+    return hasher.Finalize();
+}
+
+std::unordered_map<std::string, std::string> Translator::Translate(const std::vector<uint32_t> &binary,
+                                                                   const Reflection &reflection,
+                                                                   DiskCache *translationCache) {
+    Hasher hasher;
+
+    hasher.Update(binary.data(), binary.size() * sizeof(uint32_t));
+
+    auto binaryDigest = hasher.Finalize();
+    std::unique_ptr<spirv_cross::Parser> parser;
+    std::unordered_map<std::string, std::string> sources;
+
+    for (auto &[name, arguments] : reflection.Arguments) {
+        auto key = GetTranslationKey(binaryDigest, name);
+        std::vector<uint8_t> data;
+
+        if (translationCache->Load(key, data)) {
+            sources[name].assign(data.begin(), data.end());
+            continue;
+        }
+
+        // Parse only on the first miss and hand a copy of the IR to each entry point because CompilerMSL mutates
+        // the IR it owns.
+        if (!parser) {
+            parser = std::make_unique<spirv_cross::Parser>(binary.data(), binary.size());
+            parser->parse();
+        }
+
+        auto source = TranslateEntryPoint(parser->get_parsed_ir(), name, reflection.LiteralSamplers);
+
+        translationCache->Store(key, {source.begin(), source.end()});
+        sources[name] = std::move(source);
+    }
+
+    return sources;
+}
+
+} //namespace cml
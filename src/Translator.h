@@ -0,0 +1,39 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_TRANSLATOR_H
+#define CLMTL_TRANSLATOR_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "Reflector.h"
+
+namespace cml {
+
+class DiskCache;
+
+class Translator {
+public:
+    static std::unordered_map<std::string, std::string> Translate(const std::vector<uint32_t> &binary,
+                                                                  const Reflection &reflection,
+                                                                  DiskCache *translationCache);
+};
+
+} //namespace cml
+
+#endif //CLMTL_TRANSLATOR_H
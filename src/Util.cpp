@@ -16,12 +16,23 @@
 
 #include "Util.h"
 
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <time.h>
+
 namespace cml {
 
 bool Util::TestAnyFlagSet(uint64_t bitset, uint64_t test) {
     return (bitset & test) != 0;
 }
 
+uint64_t Util::GetHostTime() {
+    // Same clock as mach_absolute_time, which Metal uses for GPUStartTime and GPUEndTime.
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
 intptr_t Util::ReadProperty(const cl_context_properties *properties, uint64_t key) {
     for (auto iter = properties; *iter != 0; iter += 2) {
         if (*iter == key) {
@@ -84,10 +95,130 @@ size_t Util::GetFormatSize(const cl_image_format &format) {
     return GetChannelSize(format.image_channel_order) * GetPixelSize(format.image_channel_data_type);
 }
 
+void Util::ConvertToPixel(const cl_image_format &format, const void *color, uint8_t *pixel) {
+    std::array<uint32_t, 4> channels;
+
+    switch (format.image_channel_order) {
+        case CL_R:
+        case CL_INTENSITY:
+        case CL_LUMINANCE:
+            channels = {0};
+            break;
+        case CL_A:
+            channels = {3};
+            break;
+        case CL_RG:
+            channels = {0, 1};
+            break;
+        case CL_RA:
+            channels = {0, 3};
+            break;
+        case CL_RGB:
+            channels = {0, 1, 2};
+            break;
+        case CL_RGBA:
+            channels = {0, 1, 2, 3};
+            break;
+        case CL_BGRA:
+            channels = {2, 1, 0, 3};
+            break;
+        case CL_ARGB:
+            channels = {3, 0, 1, 2};
+            break;
+        default:
+            throw std::exception();
+    }
+
+    auto floatColor = static_cast<const float *>(color);
+    auto intColor = static_cast<const int32_t *>(color);
+    auto uintColor = static_cast<const uint32_t *>(color);
+    auto pixelSize = GetPixelSize(format.image_channel_data_type);
+
+    for (auto i = 0; i != GetChannelSize(format.image_channel_order); ++i) {
+        auto channel = channels[i];
+        auto data = pixel + i * pixelSize;
+
+        switch (format.image_channel_data_type) {
+            case CL_UNORM_INT8:
+                data[0] = static_cast<uint8_t>(std::lround(std::clamp(floatColor[channel], 0.0f, 1.0f) * 255.0f));
+                break;
+            case CL_SNORM_INT8:
+                reinterpret_cast<int8_t *>(data)[0] =
+                    static_cast<int8_t>(std::lround(std::clamp(floatColor[channel], -1.0f, 1.0f) * 127.0f));
+                break;
+            case CL_UNORM_INT16:
+                reinterpret_cast<uint16_t *>(data)[0] =
+                    static_cast<uint16_t>(std::lround(std::clamp(floatColor[channel], 0.0f, 1.0f) * 65535.0f));
+                break;
+            case CL_SNORM_INT16:
+                reinterpret_cast<int16_t *>(data)[0] =
+                    static_cast<int16_t>(std::lround(std::clamp(floatColor[channel], -1.0f, 1.0f) * 32767.0f));
+                break;
+            case CL_SIGNED_INT8:
+                reinterpret_cast<int8_t *>(data)[0] = static_cast<int8_t>(std::clamp(intColor[channel], -128, 127));
+                break;
+            case CL_SIGNED_INT16:
+                reinterpret_cast<int16_t *>(data)[0] =
+                    static_cast<int16_t>(std::clamp(intColor[channel], -32768, 32767));
+                break;
+            case CL_SIGNED_INT32:
+                reinterpret_cast<int32_t *>(data)[0] = intColor[channel];
+                break;
+            case CL_UNSIGNED_INT8:
+                data[0] = static_cast<uint8_t>(std::min(uintColor[channel], 255u));
+                break;
+            case CL_UNSIGNED_INT16:
+                reinterpret_cast<uint16_t *>(data)[0] = static_cast<uint16_t>(std::min(uintColor[channel], 65535u));
+                break;
+            case CL_UNSIGNED_INT32:
+                reinterpret_cast<uint32_t *>(data)[0] = uintColor[channel];
+                break;
+            case CL_HALF_FLOAT:
+                reinterpret_cast<__fp16 *>(data)[0] = static_cast<__fp16>(floatColor[channel]);
+                break;
+            case CL_FLOAT:
+                memcpy(data, &floatColor[channel], sizeof(float));
+                break;
+            default:
+                throw std::exception();
+        }
+    }
+}
+
 Size Util::ConvertToSize(cl_uint dim, const size_t *size) {
     return {size[0], dim > 1 ? size[1] : 0, dim > 2 ? size[2] : 0};
 }
 
+size_t Util::GetRectEnd(const Origin &origin, const Size &region, size_t rowPitch, size_t slicePitch) {
+    return (origin.z + region.d - 1) * slicePitch + (origin.y + region.h - 1) * rowPitch + origin.x + region.w;
+}
+
+bool Util::TestRectOverlap(const Origin &srcOrigin, const Origin &dstOrigin, const Size &region, size_t rowPitch,
+                           size_t slicePitch) {
+    auto srcBegin = static_cast<int64_t>(srcOrigin.z * slicePitch + srcOrigin.y * rowPitch + srcOrigin.x);
+    auto dstBegin = static_cast<int64_t>(dstOrigin.z * slicePitch + dstOrigin.y * rowPitch + dstOrigin.x);
+    auto width = static_cast<int64_t>(region.w);
+    auto rowCount = static_cast<int64_t>(region.h);
+    auto sliceCount = static_cast<int64_t>(region.d);
+    auto row = static_cast<int64_t>(rowPitch);
+    auto slice = static_cast<int64_t>(slicePitch);
+
+    // Both regions share a byte when the distance between one of their rows is shorter than a row. The row pitch is
+    // at least the width, so only the rows next to the closest one can qualify.
+    for (auto z = 1 - sliceCount; z < sliceCount; ++z) {
+        auto distance = dstBegin - srcBegin + z * slice;
+        auto closest = -distance / row;
+
+        for (auto y = closest - 1; y <= closest + 1; ++y) {
+            if (y > -rowCount && y < rowCount && std::abs(distance + y * row) < width) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
 cl_channel_order Util::ConvertToChannelOrder(MTL::PixelFormat format) {
     switch (format) {
         case MTL::PixelFormatA8Unorm:
@@ -22,6 +22,7 @@
 #include <CL/cl.h>
 
 #include "Metal.hpp"
+#include "Origin.h"
 #include "Size.h"
 
 namespace cml {
@@ -29,11 +30,16 @@ namespace cml {
 class Util {
 public:
     static bool TestAnyFlagSet(uint64_t bitset, uint64_t test);
+    static uint64_t GetHostTime();
     static intptr_t ReadProperty(const cl_context_properties *properties, uint64_t key);
     static size_t GetChannelSize(cl_channel_order order);
     static size_t GetPixelSize(cl_channel_type type);
     static size_t GetFormatSize(const cl_image_format &format);
+    static void ConvertToPixel(const cl_image_format &format, const void *color, uint8_t *pixel);
     static Size ConvertToSize(cl_uint dim, const size_t *size);
+    static size_t GetRectEnd(const Origin &origin, const Size &region, size_t rowPitch, size_t slicePitch);
+    static bool TestRectOverlap(const Origin &srcOrigin, const Origin &dstOrigin, const Size &region, size_t rowPitch,
+                                size_t slicePitch);
     static cl_channel_order ConvertToChannelOrder(MTL::PixelFormat format);
     static cl_channel_type ConvertToChannelType(MTL::PixelFormat format);
 };
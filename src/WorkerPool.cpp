@@ -0,0 +1,82 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include "WorkerPool.h"
+
+#include <cassert>
+
+namespace cml {
+
+WorkerPool::WorkerPool(uint32_t threadCount)
+    : mThreads{}, mTasks{}, mMutex{}, mCondition{}, mStopping{false} {
+    assert(threadCount);
+
+    for (auto i = 0; i != threadCount; ++i) {
+        mThreads.emplace_back(&WorkerPool::Run, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock{mMutex};
+        mStopping = true;
+    }
+
+    mCondition.notify_all();
+
+    for (auto &thread : mThreads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::Submit(std::function<void()> task) {
+    {
+        std::lock_guard lock{mMutex};
+        mTasks.push(std::move(task));
+    }
+
+    mCondition.notify_one();
+}
+
+uint32_t WorkerPool::GetThreadCount() const {
+    return mThreads.size();
+}
+
+void WorkerPool::Run() {
+    while (true) {
+        std::function<void()> task;
+
+        {
+            std::unique_lock lock{mMutex};
+
+            mCondition.wait(lock, [this]() {
+                return mStopping || !mTasks.empty();
+            });
+
+            // Drain the queue before stopping so every submitted build still gets its callback.
+            if (mTasks.empty()) {
+                return;
+            }
+
+            task = std::move(mTasks.front());
+            mTasks.pop();
+        }
+
+        task();
+    }
+}
+
+} //namespace cml
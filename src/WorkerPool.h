@@ -0,0 +1,49 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#ifndef CLMTL_WORKER_POOL_H
+#define CLMTL_WORKER_POOL_H
+
+#include <cstdint>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace cml {
+
+class WorkerPool {
+public:
+    explicit WorkerPool(uint32_t threadCount);
+    ~WorkerPool();
+    void Submit(std::function<void()> task);
+    uint32_t GetThreadCount() const;
+
+private:
+    std::vector<std::thread> mThreads;
+    std::queue<std::function<void()>> mTasks;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mStopping;
+
+    void Run();
+};
+
+} //namespace cml
+
+#endif //CLMTL_WORKER_POOL_H
@@ -0,0 +1,170 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <new>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "HazardTracker.h"
+#include "PipelineCache.h"
+
+using namespace cml;
+
+namespace {
+
+std::atomic<uint64_t> gAllocationCount = 0;
+
+struct StubPipeline {
+    uint64_t WorkGroupSize;
+};
+
+} //namespace
+
+void *operator new(size_t size) {
+    gAllocationCount++;
+
+    if (auto data = std::malloc(size ? size : 1)) {
+        return data;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *data) noexcept {
+    std::free(data);
+}
+
+void operator delete(void *data, size_t) noexcept {
+    std::free(data);
+}
+
+// Mirrors a dispatch on the enqueue path: look up the pipeline, then track the resources of the arguments.
+TEST(AllocationTest, EnqueuePathDoesNotAllocate) {
+    std::array<StubPipeline, 4> pipelines{};
+    PipelineCache<StubPipeline> pipelineCache;
+    HazardTracker hazardTracker;
+    uint32_t factoryCount = 0;
+    int resources[8];
+
+    auto enqueue = [&](uint32_t iteration) {
+        PipelineKey key{.WorkGroupSize = iteration % pipelines.size(), .LocalSizeId = 0};
+        auto pipeline = pipelineCache.At(key, [&]() {
+            factoryCount++;
+
+            return &pipelines[key.WorkGroupSize];
+        }, [](StubPipeline *) {
+        });
+
+        EXPECT_EQ(pipeline, &pipelines[key.WorkGroupSize]);
+
+        std::array<const void *, 2> reads{&resources[iteration % 8], &resources[(iteration + 1) % 8]};
+        std::array<const void *, 1> writes{&resources[(iteration + 2) % 8]};
+
+        if (hazardTracker.HasHazard(reads, writes)) {
+            hazardTracker.Reset();
+        }
+
+        hazardTracker.Add(reads, writes);
+    };
+
+    // The first dispatches create the pipelines and grow the hazard sets to their peak size.
+    for (uint32_t i = 0; i != 64; ++i) {
+        enqueue(i);
+    }
+
+    auto allocationCount = gAllocationCount.load();
+
+    for (uint32_t i = 0; i != 10000; ++i) {
+        enqueue(i);
+    }
+
+    EXPECT_EQ(gAllocationCount - allocationCount, 0);
+    EXPECT_EQ(factoryCount, pipelines.size());
+    EXPECT_EQ(pipelineCache.GetSize(), pipelines.size());
+}
+
+TEST(AllocationTest, PipelineCacheSeparatesLocalSizes) {
+    std::array<StubPipeline, 2> pipelines{};
+    PipelineCache<StubPipeline> pipelineCache;
+    uint32_t factoryCount = 0;
+
+    auto lookup = [&](uint32_t localSizeId) {
+        return pipelineCache.At({.WorkGroupSize = 64, .LocalSizeId = localSizeId}, [&]() {
+            return &pipelines[factoryCount++];
+        }, [](StubPipeline *) {
+        });
+    };
+
+    EXPECT_EQ(lookup(0), &pipelines[0]);
+    EXPECT_EQ(lookup(1), &pipelines[1]);
+    EXPECT_EQ(lookup(0), &pipelines[0]);
+    EXPECT_EQ(factoryCount, 2);
+}
+
+// Mirrors several threads enqueueing the same kernel. Every thread must see the pipeline that stays in the cache, and
+// pipelines created by a thread that lost the race must be discarded.
+TEST(AllocationTest, PipelineCacheIsSharedAcrossThreads) {
+    constexpr uint32_t ThreadCount = 8;
+    constexpr uint32_t KeyCount = 16;
+    PipelineCache<StubPipeline> pipelineCache;
+    std::atomic<uint32_t> createCount = 0;
+    std::atomic<uint32_t> discardCount = 0;
+    std::array<std::array<StubPipeline *, KeyCount>, ThreadCount> results{};
+    std::vector<std::thread> threads;
+
+    for (uint32_t i = 0; i != ThreadCount; ++i) {
+        threads.emplace_back([&, i]() {
+            for (uint32_t j = 0; j != 1000; ++j) {
+                PipelineKey key{.WorkGroupSize = j % KeyCount, .LocalSizeId = 0};
+                auto pipeline = pipelineCache.At(key, [&]() {
+                    createCount++;
+
+                    return new StubPipeline{key.WorkGroupSize};
+                }, [&](StubPipeline *pipeline) {
+                    discardCount++;
+
+                    delete pipeline;
+                });
+
+                if (results[i][key.WorkGroupSize]) {
+                    EXPECT_EQ(pipeline, results[i][key.WorkGroupSize]);
+                }
+
+                results[i][key.WorkGroupSize] = pipeline;
+            }
+        });
+    }
+
+    for (auto &thread: threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(pipelineCache.GetSize(), KeyCount);
+    EXPECT_EQ(createCount - discardCount, KeyCount);
+
+    for (uint32_t i = 1; i != ThreadCount; ++i) {
+        EXPECT_EQ(results[i], results[0]);
+    }
+
+    for (auto pipeline: results[0]) {
+        delete pipeline;
+    }
+}
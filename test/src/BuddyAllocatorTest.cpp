@@ -0,0 +1,108 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "BuddyAllocator.h"
+
+using namespace cml;
+
+TEST(BuddyAllocatorTest, RoundsUpToMinBlockSize) {
+    BuddyAllocator allocator{1024, 256};
+    uint64_t offset;
+
+    ASSERT_TRUE(allocator.Allocate(1, offset));
+    EXPECT_EQ(offset, 0);
+    EXPECT_EQ(allocator.GetUsedSize(), 256);
+}
+
+TEST(BuddyAllocatorTest, SplitsLargerBlocks) {
+    BuddyAllocator allocator{1024, 256};
+    uint64_t offset;
+
+    ASSERT_TRUE(allocator.Allocate(256, offset));
+    EXPECT_EQ(offset, 0);
+
+    // Splitting the whole heap leaves one free block of each smaller order.
+    EXPECT_EQ(allocator.GetLargestFreeSize(), 512);
+
+    ASSERT_TRUE(allocator.Allocate(256, offset));
+    EXPECT_EQ(offset, 256);
+
+    ASSERT_TRUE(allocator.Allocate(512, offset));
+    EXPECT_EQ(offset, 512);
+    EXPECT_EQ(allocator.GetUsedSize(), 1024);
+    EXPECT_EQ(allocator.GetLargestFreeSize(), 0);
+}
+
+TEST(BuddyAllocatorTest, CoalescesBuddies) {
+    BuddyAllocator allocator{1024, 256};
+    uint64_t offsets[4];
+
+    for (auto &offset: offsets) {
+        ASSERT_TRUE(allocator.Allocate(256, offset));
+    }
+
+    allocator.Free(offsets[0]);
+    allocator.Free(offsets[2]);
+
+    // Freed blocks that aren't buddies stay apart.
+    EXPECT_EQ(allocator.GetLargestFreeSize(), 256);
+
+    allocator.Free(offsets[1]);
+    EXPECT_EQ(allocator.GetLargestFreeSize(), 512);
+
+    allocator.Free(offsets[3]);
+    EXPECT_EQ(allocator.GetLargestFreeSize(), 1024);
+    EXPECT_EQ(allocator.GetUsedSize(), 0);
+    EXPECT_TRUE(allocator.IsEmpty());
+}
+
+TEST(BuddyAllocatorTest, FailsWhenExhausted) {
+    BuddyAllocator allocator{1024, 256};
+    uint64_t offset;
+
+    EXPECT_FALSE(allocator.Allocate(0, offset));
+    EXPECT_FALSE(allocator.Allocate(2048, offset));
+
+    for (auto i = 0; i != 4; ++i) {
+        ASSERT_TRUE(allocator.Allocate(256, offset));
+    }
+
+    EXPECT_FALSE(allocator.Allocate(1, offset));
+
+    allocator.Free(512);
+    ASSERT_TRUE(allocator.Allocate(200, offset));
+    EXPECT_EQ(offset, 512);
+}
+
+TEST(BuddyAllocatorTest, FragmentationLimitsLargeRequests) {
+    BuddyAllocator allocator{1024, 256};
+    uint64_t offsets[4];
+
+    for (auto &offset: offsets) {
+        ASSERT_TRUE(allocator.Allocate(256, offset));
+    }
+
+    allocator.Free(offsets[1]);
+    allocator.Free(offsets[2]);
+
+    // Half of the heap is free, but not as one block of buddies.
+    uint64_t offset;
+
+    EXPECT_EQ(allocator.GetUsedSize(), 512);
+    EXPECT_FALSE(allocator.Allocate(512, offset));
+}
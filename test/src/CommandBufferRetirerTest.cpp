@@ -0,0 +1,115 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "CommandBufferRetirer.h"
+
+using namespace cml;
+
+namespace {
+
+struct FakeCommandBuffer {
+    bool Completed;
+    bool Released;
+};
+
+// Stands in for Metal, so the GPU completes a command buffer whenever the test marks it.
+struct FakeRetireTraits {
+    using CommandBuffer = FakeCommandBuffer;
+
+    static bool IsCompleted(CommandBuffer *commandBuffer) {
+        return commandBuffer->Completed;
+    }
+
+    static void Release(CommandBuffer *commandBuffer) {
+        commandBuffer->Released = true;
+    }
+};
+
+using FakeCommandBufferRetirer = CommandBufferRetirer<FakeRetireTraits>;
+
+} //namespace
+
+TEST(CommandBufferRetirerTest, RetiresCompletedCommandBuffersInOrder) {
+    std::vector<FakeCommandBuffer> commandBuffers(3);
+    FakeCommandBufferRetirer retirer;
+
+    for (auto &commandBuffer: commandBuffers) {
+        retirer.Push(&commandBuffer);
+    }
+
+    // A later command buffer can't be retired before an earlier one.
+    commandBuffers[1].Completed = true;
+
+    EXPECT_EQ(retirer.Retire(), 0);
+    EXPECT_FALSE(commandBuffers[1].Released);
+
+    commandBuffers[0].Completed = true;
+
+    EXPECT_EQ(retirer.Retire(), 2);
+    EXPECT_TRUE(commandBuffers[0].Released);
+    EXPECT_TRUE(commandBuffers[1].Released);
+    EXPECT_FALSE(commandBuffers[2].Released);
+    EXPECT_EQ(retirer.GetCount(), 1);
+}
+
+TEST(CommandBufferRetirerTest, TakesOutstandingCommandBuffers) {
+    std::vector<FakeCommandBuffer> commandBuffers(2);
+    FakeCommandBufferRetirer retirer;
+
+    retirer.Push(&commandBuffers[0]);
+    retirer.Push(&commandBuffers[1]);
+
+    auto outstanding = retirer.Take();
+
+    EXPECT_EQ(outstanding.size(), 2);
+    EXPECT_EQ(outstanding.front(), &commandBuffers[0]);
+    EXPECT_EQ(retirer.GetCount(), 0);
+    EXPECT_EQ(retirer.Retire(), 0);
+}
+
+// Streams command buffers without ever waiting, the way an application that never calls clFinish does, while the GPU
+// trails the submissions. The held command buffers must stay bounded by that lag instead of growing with the run.
+TEST(CommandBufferRetirerTest, StaysBoundedWhileStreaming) {
+    constexpr size_t SubmitCount = 100000;
+    constexpr size_t Lag = 8;
+    auto commandBuffers = std::make_unique<FakeCommandBuffer[]>(SubmitCount);
+    FakeCommandBufferRetirer retirer;
+    uint64_t retireCount = 0;
+
+    for (size_t i = 0; i != SubmitCount; ++i) {
+        if (i >= Lag) {
+            commandBuffers[i - Lag].Completed = true;
+        }
+
+        retirer.Push(&commandBuffers[i]);
+        retireCount += retirer.Retire();
+
+        ASSERT_LE(retirer.GetCount(), Lag + 1);
+    }
+
+    EXPECT_LE(retirer.GetMaxCount(), Lag + 1);
+    EXPECT_EQ(retireCount, SubmitCount - retirer.GetCount());
+
+    for (size_t i = 0; i != retireCount; ++i) {
+        ASSERT_TRUE(commandBuffers[i].Released);
+    }
+}
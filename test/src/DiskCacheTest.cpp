@@ -0,0 +1,156 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <unistd.h>
+
+#include "DiskCache.h"
+
+using namespace cml;
+
+namespace {
+
+Digest GetKey(uint64_t value) {
+    Hasher hasher;
+
+    hasher.Update(&value, sizeof(value));
+
+    return hasher.Finalize();
+}
+
+class DiskCacheTest : public testing::Test {
+protected:
+    void SetUp() override {
+        mRoot = std::filesystem::temp_directory_path() / ("clmtl-test-" + std::to_string(getpid()));
+        std::filesystem::remove_all(mRoot);
+        setenv("CLMTL_CACHE_DIR", mRoot.c_str(), 1);
+        setenv("CLMTL_CACHE_SIZE", "1000", 1);
+    }
+
+    void TearDown() override {
+        unsetenv("CLMTL_CACHE_DIR");
+        unsetenv("CLMTL_CACHE_SIZE");
+        std::filesystem::remove_all(mRoot);
+    }
+
+    void SetAge(const DiskCache &cache, const Digest &key, int seconds) {
+        auto path = cache.GetDirectory() / (Hasher::ConvertToString(key) + ".bin");
+
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now() -
+                                               std::chrono::seconds(seconds));
+    }
+
+    std::filesystem::path mRoot;
+};
+
+} //namespace
+
+TEST_F(DiskCacheTest, StoresAndLoads) {
+    DiskCache cache{"test"};
+    std::vector<uint8_t> data{1, 2, 3, 4};
+    std::vector<uint8_t> loaded;
+
+    EXPECT_EQ(cache.GetDirectory(), mRoot / "test");
+    EXPECT_EQ(cache.GetCapacity(), 1000);
+    EXPECT_FALSE(cache.Load(GetKey(0), loaded));
+
+    cache.Store(GetKey(0), data);
+
+    ASSERT_TRUE(cache.Load(GetKey(0), loaded));
+    EXPECT_EQ(loaded, data);
+    EXPECT_FALSE(cache.Load(GetKey(1), loaded));
+    EXPECT_EQ(cache.GetHitCount(), 1);
+    EXPECT_EQ(cache.GetMissCount(), 2);
+}
+
+TEST_F(DiskCacheTest, PersistsAcrossInstances) {
+    std::vector<uint8_t> data(100, 7);
+    std::vector<uint8_t> loaded;
+
+    DiskCache{"test"}.Store(GetKey(0), data);
+
+    DiskCache cache{"test"};
+
+    ASSERT_TRUE(cache.Load(GetKey(0), loaded));
+    EXPECT_EQ(loaded, data);
+}
+
+TEST_F(DiskCacheTest, SkipsEntriesLargerThanCapacity) {
+    DiskCache cache{"test"};
+    std::vector<uint8_t> loaded;
+
+    cache.Store(GetKey(0), std::vector<uint8_t>(1001));
+
+    EXPECT_FALSE(cache.Load(GetKey(0), loaded));
+}
+
+TEST_F(DiskCacheTest, EvictsLeastRecentlyUsed) {
+    DiskCache cache{"test"};
+    std::vector<uint8_t> data(300);
+    std::vector<uint8_t> loaded;
+
+    for (uint64_t i = 0; i != 3; ++i) {
+        cache.Store(GetKey(i), data);
+        SetAge(cache, GetKey(i), 30 - static_cast<int>(i) * 10);
+    }
+
+    // Loading the oldest entry makes it the most recently used one.
+    ASSERT_TRUE(cache.Load(GetKey(0), loaded));
+
+    // Crossing the capacity evicts down to three quarters of it, starting with the least recently used entries.
+    cache.Store(GetKey(3), data);
+
+    EXPECT_TRUE(cache.Load(GetKey(0), loaded));
+    EXPECT_FALSE(cache.Load(GetKey(1), loaded));
+    EXPECT_FALSE(cache.Load(GetKey(2), loaded));
+    EXPECT_TRUE(cache.Load(GetKey(3), loaded));
+}
+
+TEST_F(DiskCacheTest, RewritesDoNotGrowTheSize) {
+    DiskCache cache{"test"};
+    std::vector<uint8_t> data(400);
+    std::vector<uint8_t> loaded;
+
+    cache.Store(GetKey(0), data);
+    cache.Store(GetKey(1), data);
+    SetAge(cache, GetKey(1), 30);
+
+    // Rewriting an entry replaces it, so the cache stays below its capacity and nothing is evicted.
+    for (auto i = 0; i != 8; ++i) {
+        cache.Store(GetKey(0), data);
+    }
+
+    EXPECT_TRUE(cache.Load(GetKey(0), loaded));
+    EXPECT_TRUE(cache.Load(GetKey(1), loaded));
+}
+
+TEST_F(DiskCacheTest, DisabledWithoutCapacity) {
+    setenv("CLMTL_CACHE_SIZE", "0", 1);
+
+    DiskCache cache{"test"};
+    std::vector<uint8_t> loaded;
+
+    cache.Store(GetKey(0), {1, 2, 3, 4});
+
+    EXPECT_TRUE(cache.GetDirectory().empty());
+    EXPECT_FALSE(cache.Load(GetKey(0), loaded));
+}
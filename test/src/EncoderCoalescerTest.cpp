@@ -0,0 +1,121 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "EncoderCoalescer.h"
+
+using namespace cml;
+
+namespace {
+
+struct RecordingCommandBuffer {
+    std::vector<std::string> Log;
+};
+
+struct RecordingEncoder {
+    RecordingCommandBuffer *CommandBuffer;
+};
+
+// Stands in for Metal, and records every encoder that is begun and ended in its command buffer.
+struct RecordingEncoderTraits {
+    using CommandBuffer = RecordingCommandBuffer;
+    using Encoder = RecordingEncoder;
+
+    static Encoder *Begin(CommandBuffer *commandBuffer, EncoderType type) {
+        commandBuffer->Log.emplace_back(type == EncoderType::Blit ? "blit" : "compute");
+
+        return new RecordingEncoder{commandBuffer};
+    }
+
+    static void End(Encoder *encoder) {
+        encoder->CommandBuffer->Log.emplace_back("end");
+
+        delete encoder;
+    }
+};
+
+using RecordingEncoderCoalescer = EncoderCoalescer<RecordingEncoderTraits>;
+
+} //namespace
+
+TEST(EncoderCoalescerTest, SharesEncoderAcrossCommandsOfSameType) {
+    RecordingCommandBuffer commandBuffer;
+    RecordingEncoderCoalescer encoder;
+
+    EXPECT_TRUE(encoder.Begin(&commandBuffer, EncoderType::Compute));
+
+    for (auto i = 0; i != 999; ++i) {
+        EXPECT_FALSE(encoder.Begin(&commandBuffer, EncoderType::Compute));
+    }
+
+    encoder.End();
+
+    EXPECT_EQ(encoder.GetCount(), 1);
+    EXPECT_EQ(commandBuffer.Log, (std::vector<std::string>{"compute", "end"}));
+}
+
+TEST(EncoderCoalescerTest, EndsEncoderOnTypeSwitch) {
+    RecordingCommandBuffer commandBuffer;
+    RecordingEncoderCoalescer encoder;
+
+    encoder.Begin(&commandBuffer, EncoderType::Blit);
+    encoder.Begin(&commandBuffer, EncoderType::Blit);
+    encoder.Begin(&commandBuffer, EncoderType::Compute);
+    encoder.Begin(&commandBuffer, EncoderType::Blit);
+
+    EXPECT_EQ(encoder.GetType(), EncoderType::Blit);
+    EXPECT_EQ(encoder.GetCount(), 3);
+    EXPECT_EQ(commandBuffer.Log, (std::vector<std::string>{"blit", "end", "compute", "end", "blit"}));
+}
+
+TEST(EncoderCoalescerTest, EndsEncoderOnBarrier) {
+    RecordingCommandBuffer commandBuffer;
+    RecordingEncoderCoalescer encoder;
+
+    encoder.Begin(&commandBuffer, EncoderType::Compute);
+    encoder.End();
+    encoder.End();
+
+    EXPECT_EQ(encoder.GetType(), EncoderType::None);
+    EXPECT_EQ(encoder.GetEncoder(), nullptr);
+
+    EXPECT_TRUE(encoder.Begin(&commandBuffer, EncoderType::Compute));
+    EXPECT_EQ(encoder.GetCount(), 2);
+    EXPECT_EQ(commandBuffer.Log, (std::vector<std::string>{"compute", "end", "compute"}));
+
+    encoder.End();
+}
+
+TEST(EncoderCoalescerTest, CountsEncodersPerCommandBuffer) {
+    RecordingCommandBuffer commandBuffers[2];
+    RecordingEncoderCoalescer encoder;
+
+    encoder.Begin(&commandBuffers[0], EncoderType::Blit);
+    encoder.Begin(&commandBuffers[0], EncoderType::Compute);
+    encoder.End();
+    encoder.ResetCount();
+
+    encoder.Begin(&commandBuffers[1], EncoderType::Compute);
+    encoder.End();
+
+    EXPECT_EQ(encoder.GetCount(), 1);
+    EXPECT_EQ(commandBuffers[0].Log, (std::vector<std::string>{"blit", "end", "compute", "end"}));
+    EXPECT_EQ(commandBuffers[1].Log, (std::vector<std::string>{"compute", "end"}));
+}
@@ -0,0 +1,83 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+
+#include "Hash.h"
+
+using namespace cml;
+
+namespace {
+
+Digest Hash(const void *data, size_t size) {
+    Hasher hasher;
+
+    hasher.Update(data, size);
+
+    return hasher.Finalize();
+}
+
+} //namespace
+
+// Digests name entries of the on-disk caches, so they must never change between builds or releases.
+TEST(HashTest, MatchesMurmurHash3) {
+    constexpr auto Text = "The quick brown fox jumps over the lazy dog";
+
+    EXPECT_EQ(Hash(nullptr, 0), (Digest{0, 0}));
+    EXPECT_EQ(Hash(Text, std::strlen(Text)), (Digest{0xe34bbc7bbc071b6c, 0x7a433ca9c49a9347}));
+}
+
+TEST(HashTest, StringsAreLengthPrefixed) {
+    Hasher hasher;
+
+    hasher.Update(std::string{"clmtl"});
+
+    EXPECT_EQ(hasher.Finalize(), (Digest{0x9d42f7592bd5a45c, 0xbdc5f7a6999ea62e}));
+    EXPECT_EQ(Hasher::ConvertToString(hasher.Finalize()), "bdc5f7a6999ea62e9d42f7592bd5a45c");
+
+    // Without the prefix, moving bytes from one string to the next would give the same digest.
+    Hasher lhs;
+    Hasher rhs;
+
+    lhs.Update(std::string{"ab"});
+    lhs.Update(std::string{"c"});
+    rhs.Update(std::string{"a"});
+    rhs.Update(std::string{"bc"});
+
+    EXPECT_NE(lhs.Finalize(), rhs.Finalize());
+}
+
+TEST(HashTest, PiecewiseUpdatesMatchSingleUpdate) {
+    std::string data(100, '\0');
+
+    for (size_t i = 0; i != data.size(); ++i) {
+        data[i] = static_cast<char>(i * 7);
+    }
+
+    auto expected = Hash(data.data(), data.size());
+
+    for (size_t split : {1, 8, 15, 16, 17, 33, 99}) {
+        Hasher hasher;
+
+        hasher.Update(data.data(), split);
+        hasher.Update(data.data() + split, data.size() - split);
+
+        EXPECT_EQ(hasher.Finalize(), expected) << "split at " << split;
+    }
+}
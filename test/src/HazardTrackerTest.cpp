@@ -0,0 +1,145 @@
+/***********************************************************************************************************************
+* Copyright (c) 2022-2022 Daemyung Jang.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+***********************************************************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "HazardTracker.h"
+
+using namespace cml;
+
+namespace {
+
+int gA;
+int gB;
+
+const std::vector<const void *> None{};
+const std::vector<const void *> A{&gA};
+const std::vector<const void *> B{&gB};
+
+} //namespace
+
+TEST(HazardTrackerTest, StartsEmpty) {
+    HazardTracker hazardTracker;
+
+    EXPECT_TRUE(hazardTracker.IsEmpty());
+    EXPECT_FALSE(hazardTracker.HasHazard(A, A));
+}
+
+TEST(HazardTrackerTest, ReadAfterWrite) {
+    HazardTracker hazardTracker;
+
+    hazardTracker.Add(None, A);
+
+    EXPECT_FALSE(hazardTracker.IsEmpty());
+    EXPECT_TRUE(hazardTracker.HasHazard(A, None));
+    EXPECT_FALSE(hazardTracker.HasHazard(B, None));
+}
+
+TEST(HazardTrackerTest, WriteAfterRead) {
+    HazardTracker hazardTracker;
+
+    hazardTracker.Add(A, None);
+
+    EXPECT_TRUE(hazardTracker.HasHazard(None, A));
+    EXPECT_FALSE(hazardTracker.HasHazard(None, B));
+}
+
+TEST(HazardTrackerTest, WriteAfterWrite) {
+    HazardTracker hazardTracker;
+
+    hazardTracker.Add(None, A);
+
+    EXPECT_TRUE(hazardTracker.HasHazard(None, A));
+    EXPECT_FALSE(hazardTracker.HasHazard(None, B));
+}
+
+TEST(HazardTrackerTest, ReadAfterReadIsNoHazard) {
+    HazardTracker hazardTracker;
+
+    hazardTracker.Add(A, None);
+    hazardTracker.Add(A, None);
+
+    EXPECT_FALSE(hazardTracker.HasHazard(A, None));
+}
+
+TEST(HazardTrackerTest, AccumulatesUntilReset) {
+    HazardTracker hazardTracker;
+
+    hazardTracker.Add(A, None);
+    hazardTracker.Add(None, B);
+
+    EXPECT_TRUE(hazardTracker.HasHazard(None, A));
+    EXPECT_TRUE(hazardTracker.HasHazard(B, None));
+
+    hazardTracker.Reset();
+
+    EXPECT_TRUE(hazardTracker.IsEmpty());
+    EXPECT_FALSE(hazardTracker.HasHazard(None, A));
+    EXPECT_FALSE(hazardTracker.HasHazard(B, None));
+}
+
+TEST(HazardTrackerTest, IgnoresDuplicates) {
+    HazardTracker hazardTracker;
+    std::vector<const void *> reads{&gA, &gA, &gB};
+
+    hazardTracker.Add(reads, None);
+
+    EXPECT_TRUE(hazardTracker.HasHazard(None, A));
+    EXPECT_TRUE(hazardTracker.HasHazard(None, B));
+    EXPECT_FALSE(hazardTracker.HasHazard(reads, None));
+}
+
+namespace {
+
+// Replays dispatches the way an out-of-order queue does, and counts the barriers between them.
+uint32_t CountBarriers(const std::vector<std::pair<std::vector<const void *>, std::vector<const void *>>> &dispatches) {
+    HazardTracker hazardTracker;
+    uint32_t barrierCount = 0;
+
+    for (auto &[reads, writes] : dispatches) {
+        if (hazardTracker.HasHazard(reads, writes)) {
+            hazardTracker.Reset();
+            barrierCount++;
+        }
+
+        hazardTracker.Add(reads, writes);
+    }
+
+    return barrierCount;
+}
+
+} //namespace
+
+TEST(HazardTrackerTest, BarriersOnlyBetweenDependentDispatches) {
+    int resources[8];
+    std::vector<std::pair<std::vector<const void *>, std::vector<const void *>>> independent;
+    std::vector<std::pair<std::vector<const void *>, std::vector<const void *>>> chain;
+    std::vector<std::pair<std::vector<const void *>, std::vector<const void *>>> fanIn;
+
+    for (auto i = 0; i != 7; ++i) {
+        independent.push_back({{&resources[7]}, {&resources[i]}});
+        chain.push_back({{&resources[i]}, {&resources[i + 1]}});
+        fanIn.push_back({{&resources[7]}, {&resources[i]}});
+    }
+
+    fanIn.push_back({{&resources[0], &resources[1], &resources[2]}, {&resources[7]}});
+
+    EXPECT_EQ(CountBarriers(independent), 0);
+    EXPECT_EQ(CountBarriers(chain), 6);
+    EXPECT_EQ(CountBarriers(fanIn), 1);
+}